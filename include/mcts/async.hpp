@@ -0,0 +1,78 @@
+#ifndef MCTS_ASYNC_HPP
+#define MCTS_ASYNC_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mcts {
+
+    /// Asynchronous simulators compute transitions in the background (e.g. an external simulator behind a socket),
+    /// so that MCTSNode::compute_async can keep many rollouts in flight on a single thread:
+    ///   void submit(size_t ticket, const State& from, const Action& action)
+    ///     start the transition (`from` is only valid during the call)
+    ///   template <typename Done> void poll(Done done)
+    ///     wait for at least one submitted transition to finish, then call
+    ///     done(ticket, const State& to, double reward) for every finished one (done may submit again)
+
+    /// local mock of an asynchronous simulator: State::move and the reward functor run at submit(),
+    /// their result is delivered `latency` later (the waiting does not use the CPU)
+    /// RewardFunc: double operator()(const State& from, const Action& action, const State& to)
+    template <typename State, typename Action, typename RewardFunc>
+    class LatencySimulator {
+    public:
+        LatencySimulator(RewardFunc rfun, std::chrono::microseconds latency) : _rfun(std::move(rfun)), _latency(latency), _transitions(0) {}
+
+        void submit(size_t ticket, const State& from, const Action& action)
+        {
+            State to = from.move(action);
+            double reward = _rfun(from, action, to);
+            // same latency for all: the queue stays sorted by due time
+            _pending.push_back(Pending{ticket, std::chrono::steady_clock::now() + _latency, std::move(to), reward});
+        }
+
+        template <typename Done>
+        void poll(Done done)
+        {
+            if (_pending.empty())
+                return;
+            std::this_thread::sleep_until(_pending.front().due);
+
+            // `done` may submit new transitions: deliver the ones due now from a separate list
+            auto now = std::chrono::steady_clock::now();
+            while (!_pending.empty() && _pending.front().due <= now) {
+                _ready.push_back(std::move(_pending.front()));
+                _pending.pop_front();
+            }
+            for (const Pending& p : _ready)
+                done(p.ticket, p.to, p.reward);
+            _transitions += _ready.size();
+            _ready.clear();
+        }
+
+        /// transitions delivered so far
+        size_t transitions() const
+        {
+            return _transitions;
+        }
+
+    protected:
+        struct Pending {
+            size_t ticket;
+            std::chrono::steady_clock::time_point due;
+            State to;
+            double reward;
+        };
+
+        RewardFunc _rfun;
+        std::chrono::microseconds _latency;
+        std::deque<Pending> _pending;
+        std::vector<Pending> _ready;
+        size_t _transitions;
+    };
+} // namespace mcts
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef MCTS_BUDGET_HPP
+#define MCTS_BUDGET_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
+namespace mcts {
+
+    // Stopping criteria for MCTSNode::compute(rfun, stop):
+    // bool operator()(Node& root, size_t iterations) is called before every iteration
+    // and returns true when the search should stop
+
+    struct IterationBudget {
+        IterationBudget(size_t iterations) : _iterations(iterations) {}
+
+        template <typename Node>
+        bool operator()(Node&, size_t iterations)
+        {
+            return iterations >= _iterations;
+        }
+
+    protected:
+        size_t _iterations;
+    };
+
+    /// wall-clock budget, counted from construction
+    /// the clock is only read every few iterations: each check aims the next one at
+    /// half of the remaining time, given the measured duration of an iteration
+    struct TimeBudget {
+        using clock = std::chrono::steady_clock;
+
+        template <typename Rep, typename Period>
+        TimeBudget(const std::chrono::duration<Rep, Period>& budget) : _deadline(clock::now() + std::chrono::duration_cast<clock::duration>(budget)), _last_time(clock::now()), _last_iterations(0), _next_check(0) {}
+
+        template <typename Node>
+        bool operator()(Node&, size_t iterations)
+        {
+            if (iterations < _next_check)
+                return false;
+
+            clock::time_point now = clock::now();
+            if (now >= _deadline)
+                return true;
+
+            double per_iteration = 0.0;
+            if (iterations > _last_iterations)
+                per_iteration = std::chrono::duration<double>(now - _last_time).count() / double(iterations - _last_iterations);
+            double remaining = std::chrono::duration<double>(_deadline - now).count();
+
+            size_t stride = 1;
+            if (per_iteration > 0.0)
+                stride = std::max(size_t(1), static_cast<size_t>(0.5 * remaining / per_iteration));
+
+            _last_time = now;
+            _last_iterations = iterations;
+            _next_check = iterations + stride;
+            return false;
+        }
+
+    protected:
+        clock::time_point _deadline, _last_time;
+        size_t _last_iterations, _next_check;
+    };
+
+    /// stop once the tree holds `max_nodes` nodes
+    struct NodeBudget {
+        NodeBudget(size_t max_nodes) : _max_nodes(max_nodes) {}
+
+        template <typename Node>
+        bool operator()(Node& root, size_t)
+        {
+            return root.usage().nodes >= _max_nodes;
+        }
+
+    protected:
+        size_t _max_nodes;
+    };
+
+    /// convergence: stop once best_action() has not changed for `stable_iterations` iterations
+    /// (checked every `check_every` iterations)
+    struct StableBestAction {
+        StableBestAction(size_t stable_iterations, size_t check_every = 1) : _stable_iterations(stable_iterations), _check_every(std::max(check_every, size_t(1))), _best(nullptr), _since(0) {}
+
+        template <typename Node>
+        bool operator()(Node& root, size_t iterations)
+        {
+            if (iterations % _check_every != 0)
+                return false;
+
+            const void* best = root.best_action().get();
+            if (best == nullptr || best != _best) {
+                _best = best;
+                _since = iterations;
+                return false;
+            }
+
+            return (iterations - _since) >= _stable_iterations;
+        }
+
+    protected:
+        size_t _stable_iterations, _check_every;
+        const void* _best;
+        size_t _since;
+    };
+
+    /// stop as soon as one of the criteria says so
+    /// (a chain of plain members rather than a std::tuple: it stays trivially copyable when the criteria are,
+    /// so that compute_distributed() can send it to other processes)
+    template <typename... Stops>
+    struct StopAny;
+
+    template <>
+    struct StopAny<> {
+        template <typename Node>
+        bool operator()(Node&, size_t)
+        {
+            return false;
+        }
+    };
+
+    template <typename Stop, typename... Stops>
+    struct StopAny<Stop, Stops...> {
+        StopAny(const Stop& stop, const Stops&... stops) : _stop(stop), _stops(stops...) {}
+
+        template <typename Node>
+        bool operator()(Node& root, size_t iterations)
+        {
+            // evaluate all of them: criteria may keep track of the iterations
+            bool stop = _stop(root, iterations);
+            bool others = _stops(root, iterations);
+            return stop || others;
+        }
+
+    protected:
+        Stop _stop;
+        StopAny<Stops...> _stops;
+    };
+
+    template <typename... Stops>
+    StopAny<Stops...> stop_any(const Stops&... stops)
+    {
+        return StopAny<Stops...>(stops...);
+    }
+
+    static_assert(std::is_trivially_copyable<StopAny<IterationBudget, TimeBudget, NodeBudget, StableBestAction>>::value, "StopAny: the criteria of the library must stay trivially copyable");
+} // namespace mcts
+
+#endif
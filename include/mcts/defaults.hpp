@@ -1,7 +1,17 @@
 #ifndef MCTS_DEFAULTS_HPP
 #define MCTS_DEFAULTS_HPP
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include <mcts/parallel.hpp>
+#include <mcts/random.hpp>
+#include <mcts/traits.hpp>
+#include <mcts/transposition.hpp>
 
 namespace mcts {
 
@@ -34,17 +44,50 @@ namespace mcts {
         template <typename MCTSAction>
         auto operator()(const std::shared_ptr<MCTSAction>& action) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
         {
-            using NodeType = typename std::remove_reference<decltype(*(action->parent()))>::type;
             auto st = action->parent()->state()->move(action->action());
-            auto to_add = std::make_shared<NodeType>(st, action->parent()->rollout_depth(), action->parent()->gamma());
-            auto it = std::find_if(action->children().begin(), action->children().end(), [&](std::shared_ptr<NodeType> const& p) { return *(p->state()) == *(to_add->state()); });
-            if (action->children().size() == 0 || it == action->children().end()) {
-                to_add->parent() = action;
-                action->children().push_back(to_add);
-                return to_add;
-            }
+            auto node = action->find_child(st);
+            if (!node)
+                return action->add_child(st);
 
-            return (*it);
+            return node;
+        }
+    };
+
+    /// SimpleOutcomeSelect with a transposition table of Params::transposition::size() nodes:
+    /// an outcome state already reached at the same depth through another path reuses that node
+    /// (the tree becomes a DAG); needs child_hash<State>
+    template <typename Params>
+    struct TranspositionOutcomeSelect {
+        static constexpr bool shares_nodes = true;
+
+        template <typename MCTSAction>
+        auto operator()(const std::shared_ptr<MCTSAction>& action) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
+        {
+            using node_type = typename std::remove_reference<decltype(*(action->parent()))>::type;
+
+            auto st = action->parent()->state()->move(action->action());
+            auto node = action->find_child(st);
+            if (node)
+                return node;
+
+            auto& table = action->parent()->storage().slots().template get<TranspositionTable<node_type>>(Params::transposition::size());
+            bool created = false;
+            node = table.find_or_insert(st, action->parent()->depth() + 1, [&]() {
+                created = true;
+                return action->add_child(st);
+            });
+            if (!created)
+                action->attach_child(node);
+
+            return node;
+        }
+
+        /// enter a node of a copied or loaded tree in the table of that tree
+        template <typename Node>
+        static void record(const std::shared_ptr<Node>& node)
+        {
+            auto& table = node->storage().slots().template get<TranspositionTable<Node>>(Params::transposition::size());
+            table.find_or_insert(*(node->state()), node->depth(), [&]() { return node; });
         }
     };
 
@@ -59,6 +102,18 @@ namespace mcts {
             // return action->value() / (double(action->visits()) + _epsilon) + _c * std::sqrt(2.0 * std::log(action->parent()->visits() + 1.0) / (double(action->visits()) + _epsilon));
             return action->value() / (double(action->visits()) + _epsilon) + 2.0 * Params::uct::c() * std::sqrt(std::log(action->parent()->visits() + 1.0) / (double(action->visits()) + _epsilon));
         }
+
+        /// batched form: the log term of the parent is computed once
+        /// (the loop vectorizes when sqrt does not have to set errno, e.g. with -fno-math-errno)
+        void operator()(double parent_visits, const double* values, const double* visits, double* scores, size_t n)
+        {
+            const double c = 2.0 * Params::uct::c();
+            const double log_parent = std::log(parent_visits + 1.0);
+            for (size_t i = 0; i < n; i++) {
+                double inv = 1.0 / (visits[i] + _epsilon);
+                scores[i] = values[i] * inv + c * std::sqrt(log_parent * inv);
+            }
+        }
     };
 
     struct GreedyValue {
@@ -69,10 +124,221 @@ namespace mcts {
         {
             return action->value() / (double(action->visits()) + _epsilon);
         }
+
+        void operator()(double, const double* values, const double* visits, double* scores, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                scores[i] = values[i] / (visits[i] + _epsilon);
+        }
+    };
+
+    /// returns of an iteration on their way up its path: sum and sum of squares of `count` returns
+    struct Returns {
+        double value = 0.0, squared_value = 0.0;
+        size_t count = 1;
+
+        /// every return becomes reward + gamma * return
+        void discount(double reward, double gamma)
+        {
+            squared_value = count * reward * reward + 2.0 * reward * gamma * value + gamma * gamma * squared_value;
+            value = count * reward + gamma * value;
+        }
+    };
+
+    /// Action statistics keep the returns backed up through an action (see backup_statistics):
+    ///   double value(size_t visits) const; double squared_value(size_t visits) const; (sums over `visits` visits)
+    ///   void add(double value, double squared_value, size_t visits, size_t count);
+    ///     (sums of `count` more visits, `visits` being the visits before them)
+    ///   static constexpr bool lock_free; (add_atomic(value, squared_value) may run concurrently)
+
+    /// sums of the returns and of their squares (the default)
+    struct SumStatistics {
+        static constexpr bool lock_free = true;
+
+        explicit SumStatistics(double value) : _value(value), _squared_value(0.0) {}
+
+        double value(size_t) const
+        {
+            return _value;
+        }
+
+        double squared_value(size_t) const
+        {
+            return _squared_value;
+        }
+
+        par::relaxed_atomic<double>& value()
+        {
+            return _value;
+        }
+
+        par::relaxed_atomic<double>& squared_value()
+        {
+            return _squared_value;
+        }
+
+        void add(double value, double squared_value, size_t, size_t)
+        {
+            _value += value;
+            _squared_value += squared_value;
+        }
+
+        void add_atomic(double value, double squared_value)
+        {
+            _value.fetch_add(value);
+            _squared_value.fetch_add(squared_value);
+        }
+
+    protected:
+        par::relaxed_atomic<double> _value, _squared_value;
+    };
+
+    /// a statistic of an action returned by its deprecated writable accessors (see MCTSAction::visits()):
+    /// reads are plain reads, writes bypass update_stats() and warn
+    template <typename T>
+    class WritableStatistic {
+    public:
+        explicit WritableStatistic(par::relaxed_atomic<T>& v) : _v(v) {}
+
+        operator T() const
+        {
+            return _v.load();
+        }
+
+        [[deprecated("update the statistics of an action through update_stats()")]] WritableStatistic& operator=(T v)
+        {
+            _v.store(v);
+            return *this;
+        }
+
+        [[deprecated("update the statistics of an action through update_stats()")]] WritableStatistic& operator+=(T v)
+        {
+            _v += v;
+            return *this;
+        }
+
+        [[deprecated("update the statistics of an action through update_stats()")]] WritableStatistic& operator-=(T v)
+        {
+            _v -= v;
+            return *this;
+        }
+
+        [[deprecated("update the statistics of an action through update_stats()")]] WritableStatistic& operator++()
+        {
+            ++_v;
+            return *this;
+        }
+
+        [[deprecated("update the statistics of an action through update_stats()")]] T operator++(int)
+        {
+            return _v++;
+        }
+
+        [[deprecated("update the statistics of an action through update_stats()")]] T fetch_add(T v)
+        {
+            return _v.fetch_add(v);
+        }
+
+    protected:
+        par::relaxed_atomic<T>& _v;
+    };
+
+    /// running means of the returns and of their squares, updated incrementally:
+    /// they stay in the range of a single return, where sums lose precision as they grow
+    /// (`Value` = float halves the size of the statistics); the initial value is kept apart
+    template <typename Value = double>
+    struct MeanStatistics {
+        static constexpr bool lock_free = false;
+
+        explicit MeanStatistics(double value) : _init(Value(value)), _mean(0), _squared_mean(0) {}
+
+        double value(size_t visits) const
+        {
+            return double(_init) + double(_mean) * double(visits);
+        }
+
+        double squared_value(size_t visits) const
+        {
+            return double(_squared_mean) * double(visits);
+        }
+
+        void add(double value, double squared_value, size_t visits, size_t count)
+        {
+            double n = double(visits + count);
+            if (n == 0.0)
+                return;
+            double mean = _mean, squared_mean = _squared_mean;
+            _mean = Value(mean + (value - double(count) * mean) / n);
+            _squared_mean = Value(squared_mean + (squared_value - double(count) * squared_mean) / n);
+        }
+
+    protected:
+        par::relaxed_atomic<Value> _init, _mean, _squared_mean;
+    };
+
+    /// Backup operators decide what a node passes up to the action leading to it, once its own statistics are updated:
+    ///   template <typename Node> void operator()(const Node& node, Returns& returns)
+    /// and may choose the statistics of the actions: using statistics_type = ...; (SumStatistics otherwise)
+
+    /// Monte Carlo backup: the sampled returns go all the way up
+    struct MeanBackup {
+        template <typename Node>
+        void operator()(const Node&, Returns&)
+        {
+        }
+    };
+
+    /// Monte Carlo backup into actions keeping the running mean of their returns instead of their sum
+    /// (IncrementalMeanBackup<float>: compact actions whose statistics do not drift over long searches)
+    template <typename Value = double>
+    struct IncrementalMeanBackup : public MeanBackup {
+        using statistics_type = MeanStatistics<Value>;
+    };
+
+    /// max backup: a node passes up the mean value of its best visited action instead of the sampled returns
+    /// (less noisy with many actions but biased upwards; above it, squared values only reflect that mean)
+    struct MaxBackup {
+        template <typename Node>
+        void operator()(const Node& node, Returns& returns)
+        {
+            // other threads can add actions meanwhile (MCTSNode::compute_shared)
+            std::lock_guard<par::spin_lock> lock(node.mutex());
+            bool found = false;
+            double best = 0.0;
+            for (const auto& action : node.children()) {
+                size_t visits = action->visits();
+                if (visits == 0)
+                    continue;
+                double mean = action->value() / double(visits);
+                if (!found || mean > best)
+                    best = mean;
+                found = true;
+            }
+            if (!found)
+                return;
+            returns.value = returns.count * best;
+            returns.squared_value = returns.count * best * best;
+        }
+    };
+
+    /// the statistics of the actions chosen by a Backup operator
+    template <typename Backup, typename = void>
+    struct backup_statistics {
+        using type = SumStatistics;
+    };
+
+    template <typename Backup>
+    struct backup_statistics<Backup, void_t<typename Backup::statistics_type>> {
+        using type = typename Backup::statistics_type;
     };
 
     template <typename State, typename Action>
     struct UniformRandomPolicy {
+        Action operator()(const State& state)
+        {
+            return state.random_action();
+        }
+
         Action operator()(const std::shared_ptr<State>& state)
         {
             return state->random_action();
@@ -99,37 +365,17 @@ namespace mcts {
         template <typename Action>
         auto operator()(const std::shared_ptr<Action>& action) -> std::shared_ptr<typename std::remove_reference<decltype(*(action->parent()))>::type>
         {
-            using NodeType = typename std::remove_reference<decltype(*(action->parent()))>::type;
-
             if (action->visits() == 0 || std::pow((double)action->visits(), Params::cont_outcome::b()) > action->children().size()) {
                 auto st = action->parent()->state()->move(action->action());
-                auto to_add = std::make_shared<NodeType>(st, action->parent()->rollout_depth(), action->parent()->gamma());
-                auto it = std::find_if(action->children().begin(), action->children().end(), [&](std::shared_ptr<NodeType> const& p) { return *(p->state()) == *(to_add->state()); });
-                if (action->children().size() == 0 || it == action->children().end()) {
-                    to_add->parent() = action;
-                    action->children().push_back(to_add);
-                    return to_add;
-                }
-
-                return (*it);
-            }
+                auto node = action->find_child(st);
+                if (!node)
+                    return action->add_child(st);
 
-            // Choose child with probability: n(c)/Sum(n(c'))
-            size_t sum = 0;
-            for (size_t i = 0; i < action->children().size(); i++) {
-                sum += action->children()[i]->visits();
-            }
-            size_t r = static_cast<size_t>(std::rand() * double(sum) / double(RAND_MAX));
-            size_t p = 0;
-            for (auto child : action->children()) {
-                p += child->visits();
-                if (r <= p)
-                    return child;
+                return node;
             }
 
-            // we should never reach here
-            assert(false);
-            return nullptr;
+            // Choose child with probability: n(c)/Sum(n(c')) (O(log n), see MCTSAction::sample_child)
+            return action->sample_child();
         }
     };
 } // namespace mcts
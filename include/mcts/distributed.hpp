@@ -0,0 +1,412 @@
+#ifndef MCTS_DISTRIBUTED_HPP
+#define MCTS_DISTRIBUTED_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <mcts/memory.hpp>
+#include <mcts/parallel.hpp>
+#include <mcts/random.hpp>
+#include <mcts/serialize.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define MCTS_HAS_FORK
+#endif
+
+namespace mcts {
+
+    /// statistics of the actions of a root, as sent back by a search worker
+    template <typename Action>
+    struct RootStats {
+        struct Entry {
+            Action action;
+            double value, squared_value;
+            size_t visits;
+        };
+
+        size_t iterations = 0, visits = 0;
+        std::vector<Entry> actions;
+
+        /// compact binary form: iterations, visits, actions, then value, squared value, visits and action each
+        std::string encode() const
+        {
+            BinaryWriter out;
+            out.write(uint64_t(iterations));
+            out.write(uint64_t(visits));
+            out.write(uint32_t(actions.size()));
+            for (const Entry& e : actions) {
+                out.write(e.value);
+                out.write(e.squared_value);
+                out.write(uint64_t(e.visits));
+                serializer<Action>::write(out, e.action);
+            }
+            return out.bytes();
+        }
+
+        /// throws std::runtime_error on a truncated message
+        static RootStats decode(const std::string& bytes)
+        {
+            BinaryReader in(bytes.data(), bytes.data() + bytes.size());
+            RootStats stats;
+            stats.iterations = in.read<uint64_t>();
+            stats.visits = in.read<uint64_t>();
+            uint32_t n = in.read<uint32_t>();
+            for (uint32_t i = 0; i < n; i++) {
+                double value = in.read<double>();
+                double squared_value = in.read<double>();
+                size_t visits = in.read<uint64_t>();
+                Action action = serializer<Action>::read(in);
+                stats.actions.push_back(Entry{action, value, squared_value, visits});
+            }
+            return stats;
+        }
+    };
+
+    /// the statistics of the actions of `root`
+    template <typename Node>
+    RootStats<snapshot::action_t<Node>> root_stats(const Node& root, size_t iterations = 0)
+    {
+        RootStats<snapshot::action_t<Node>> stats;
+        stats.iterations = iterations;
+        stats.visits = root.visits();
+        for (const auto& action : root.children())
+            stats.actions.push_back({action->action(), action->value(), action->squared_value(), action->visits()});
+        return stats;
+    }
+
+    /// add root statistics to `root` (like merge_inplace, limited to the first level)
+    template <typename Node, typename Action>
+    void merge_root_stats(Node& root, const RootStats<Action>& stats)
+    {
+        root.visits() += stats.visits;
+        for (const auto& e : stats.actions) {
+            auto action = root.find_child(e.action);
+            if (!action)
+                action = root.add_action(e.action);
+            action->update_stats(e.value, e.squared_value, e.visits);
+        }
+    }
+
+    /// Transports run the jobs of the search workers somewhere and bring their results back:
+    ///   template <typename Job> std::vector<std::string> run(const std::vector<std::string>& requests);
+    /// where `static std::string Job::run(const std::string& request)` does the work of one worker from the
+    /// bytes of its request; results come back in request order. Everything a job needs is in its request:
+    /// the job may run in another process.
+    /// A transport spanning several hosts runs the same program everywhere and gathers the results.
+
+    /// workers are tasks of this process (no serialization boundary besides the encoding)
+    struct LocalTransport {
+        template <typename Job>
+        std::vector<std::string> run(const std::vector<std::string>& requests)
+        {
+            std::vector<std::string> results(requests.size());
+            par::loop(0, requests.size(), [&](size_t i) {
+                // clang-format off
+                results[i] = Job::run(requests[i]);
+                // clang-format on
+            });
+            return results;
+        }
+    };
+
+#ifdef MCTS_HAS_FORK
+    /// workers are child processes (e.g. one per NUMA node) started by the constructor, which serve the
+    /// requests sent over Unix sockets until the transport is destroyed
+    /// - fork() only copies the calling thread, and a child could block forever on a lock held by another one:
+    ///   build the transport before the process starts threads, i.e. before par::init() or the first
+    ///   par:: call (asserted); the par:: context of the children is their own, built by their first job
+    /// - the children are copies of the process as it was then: Job::run is at the same address there,
+    ///   but parameters set later (e.g. MCTS_DYN_PARAM) are not seen
+    /// - request i goes to child i % processes(); each child runs its requests in turn
+    /// run() throws std::runtime_error if a job threw or a child did not send a complete result
+    class ForkTransport {
+    public:
+        /// `processes` children (0: one per hardware thread); throws std::runtime_error if one could not be started
+        explicit ForkTransport(size_t processes = 0)
+        {
+            assert(!par::detail::raw_state().configured.load() && "ForkTransport built after the execution context");
+            if (processes == 0)
+                processes = std::max(1u, std::thread::hardware_concurrency());
+
+            // buffered output would be written by every child
+            std::fflush(nullptr);
+
+            for (size_t i = 0; i < processes; i++) {
+                int fds[2];
+                if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                    _shutdown();
+                    throw std::runtime_error("mcts: socketpair failed");
+                }
+
+                pid_t pid = ::fork();
+                if (pid < 0) {
+                    ::close(fds[0]);
+                    ::close(fds[1]);
+                    _shutdown();
+                    throw std::runtime_error("mcts: fork failed");
+                }
+
+                if (pid == 0) {
+                    ::close(fds[0]);
+                    for (int s : _sockets)
+                        ::close(s);
+                    ::_exit(_serve(fds[1]));
+                }
+
+                ::close(fds[1]);
+                _pids.push_back(pid);
+                _sockets.push_back(fds[0]);
+            }
+        }
+
+        ForkTransport(const ForkTransport&) = delete;
+        ForkTransport& operator=(const ForkTransport&) = delete;
+
+        ~ForkTransport()
+        {
+            _shutdown();
+        }
+
+        size_t processes() const
+        {
+            return _sockets.size();
+        }
+
+        template <typename Job>
+        std::vector<std::string> run(const std::vector<std::string>& requests)
+        {
+            const uint64_t entry = uint64_t(reinterpret_cast<uintptr_t>(&Job::run));
+            const size_t n = _sockets.size();
+            std::vector<std::string> results(requests.size());
+            bool complete = true;
+
+            // a round sends one request to every child and reads its result:
+            // neither side blocks writing while the other one does
+            for (size_t first = 0; first < requests.size(); first += n) {
+                size_t last = std::min(first + n, requests.size());
+                std::vector<bool> sent(last - first, false);
+                for (size_t i = first; i < last; i++) {
+                    int s = _sockets[i - first];
+                    uint64_t size = requests[i].size();
+                    sent[i - first] = _write_all(s, &entry, sizeof(entry)) && _write_all(s, &size, sizeof(size)) && _write_all(s, requests[i].data(), requests[i].size());
+                }
+                for (size_t i = first; i < last; i++) {
+                    int& s = _sockets[i - first];
+                    bool ok = false;
+                    if (sent[i - first] && _read_result(s, results[i], ok)) {
+                        complete = complete && ok;
+                        continue;
+                    }
+                    // the stream of this child is lost: later runs fail at once
+                    ::close(s);
+                    s = -1;
+                    complete = false;
+                }
+            }
+
+            if (!complete)
+                throw std::runtime_error("mcts: a search worker failed");
+            return results;
+        }
+
+    protected:
+        using entry_type = std::string (*)(const std::string&);
+
+        std::vector<pid_t> _pids;
+        std::vector<int> _sockets;
+
+        // child: runs the requests until the parent closes the socket, returns the exit status
+        static int _serve(int fd)
+        {
+            while (true) {
+                uint64_t entry = 0, size = 0;
+                if (!_read_all(fd, &entry, sizeof(entry)))
+                    return 0;
+                std::string request;
+                if (!_read_all(fd, &size, sizeof(size)))
+                    return 1;
+                request.resize(size);
+                if (size > 0 && !_read_all(fd, &request[0], size))
+                    return 1;
+
+                uint8_t ok = 0;
+                std::string result;
+                try {
+                    result = reinterpret_cast<entry_type>(uintptr_t(entry))(request);
+                    ok = 1;
+                }
+                catch (...) {
+                    result.clear();
+                }
+                size = result.size();
+                if (!_write_all(fd, &ok, sizeof(ok)) || !_write_all(fd, &size, sizeof(size)) || !_write_all(fd, result.data(), result.size()))
+                    return 1;
+            }
+        }
+
+        // false if the result could not be read, `ok` false if the job threw
+        static bool _read_result(int fd, std::string& result, bool& ok)
+        {
+            uint8_t status = 0;
+            uint64_t size = 0;
+            if (!_read_all(fd, &status, sizeof(status)) || !_read_all(fd, &size, sizeof(size)))
+                return false;
+            result.resize(size);
+            if (size > 0 && !_read_all(fd, &result[0], size))
+                return false;
+            ok = (status == 1);
+            return true;
+        }
+
+        static bool _write_all(int fd, const void* data, size_t size)
+        {
+#ifdef MSG_NOSIGNAL
+            // a child that exited must not kill the process with SIGPIPE
+            const int flags = MSG_NOSIGNAL;
+#else
+            const int flags = 0;
+#endif
+            const char* p = static_cast<const char*>(data);
+            while (size > 0) {
+                ssize_t n = ::send(fd, p, size, flags);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                p += n;
+                size -= size_t(n);
+            }
+            return true;
+        }
+
+        static bool _read_all(int fd, void* data, size_t size)
+        {
+            char* p = static_cast<char*>(data);
+            while (size > 0) {
+                ssize_t n = ::read(fd, p, size);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                p += n;
+                size -= size_t(n);
+            }
+            return true;
+        }
+
+        // closing the sockets stops the children: reap them
+        void _shutdown()
+        {
+            for (int s : _sockets) {
+                if (s >= 0)
+                    ::close(s);
+            }
+            for (pid_t pid : _pids) {
+                int status = 0;
+                while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+                    ;
+            }
+            _sockets.clear();
+            _pids.clear();
+        }
+    };
+#endif
+
+    namespace detail {
+        // job of compute_distributed(): one tree searched from the state of the request
+        template <typename Node, typename RewardFunc, typename Stop>
+        struct DistributedSearch {
+            using state_type = typename Node::state_type;
+
+            static std::string request(size_t worker, uint64_t salt, const Node& root, const MemoryBudget& budget, const RewardFunc& rfun, const Stop& stop)
+            {
+                BinaryWriter out;
+                out.write(uint64_t(worker));
+                out.write(rng::detail::global().seed.load());
+                out.write(salt);
+                out.write(uint64_t(root.rollout_depth()));
+                out.write(root.gamma());
+                out.write(budget);
+                write_object(out, rfun);
+                write_object(out, stop);
+                serializer<state_type>::write(out, *(root.state()));
+                return out.bytes();
+            }
+
+            static std::string run(const std::string& request)
+            {
+                BinaryReader in(request.data(), request.data() + request.size());
+                size_t worker = in.read<uint64_t>();
+                uint64_t seed = in.read<uint64_t>();
+                uint64_t salt = in.read<uint64_t>();
+                size_t rollout_depth = in.read<uint64_t>();
+                double gamma = in.read<double>();
+                MemoryBudget budget = in.read<MemoryBudget>();
+                ObjectCopy<RewardFunc> rfun(in);
+                ObjectCopy<Stop> stop(in);
+                state_type state = serializer<state_type>::read(in);
+
+                // a child process may have been forked before the last rng::seed()
+                if (rng::detail::global().seed.load() != seed)
+                    rng::seed(seed);
+                rng::seed_worker(worker, salt);
+                auto tree = std::make_shared<Node>(state, rollout_depth, gamma);
+                tree->set_memory_budget(budget);
+                size_t k = 0;
+                while (!stop.get()(*tree, k)) {
+                    tree->iterate(rfun.get());
+                    k++;
+                }
+                return root_stats(*tree, k).encode();
+            }
+        };
+    } // namespace detail
+
+    /// root parallelization through a transport: every worker searches its own tree from the state of `root`
+    /// until `stop(tree, iterations)` returns true (see budget.hpp), sequentially and on its own random stream
+    /// (a new one at every call, see rng::next_salt()) and within its share of the memory budget of `root`;
+    /// their root statistics are added to `root`. Returns the total number of iterations.
+    /// The state goes to the workers through serializer<State>, `rfun` and `stop` as copies of their bytes
+    /// (see write_object(); the criteria of budget.hpp and their stop_any() qualify, a TimeBudget keeps its
+    /// steady_clock deadline, shared by the processes of a machine).
+    template <typename Node, typename Transport, typename RewardFunc, typename Stop>
+    size_t compute_distributed(Node& root, Transport& transport, size_t workers, RewardFunc rfun, Stop stop)
+    {
+        using action_type = snapshot::action_t<Node>;
+        using job_type = detail::DistributedSearch<Node, RewardFunc, Stop>;
+        // the workers may share the memory of this machine (LocalTransport, ForkTransport)
+        const MemoryBudget budget = root.memory_budget().split(workers);
+
+        // a local transport may run a worker on the calling thread
+        rng::GeneratorGuard guard;
+        const uint64_t salt = rng::next_salt();
+        std::vector<std::string> requests;
+        for (size_t worker = 0; worker < workers; worker++)
+            requests.push_back(job_type::request(worker, salt, root, budget, rfun, stop));
+        std::vector<std::string> results = transport.template run<job_type>(requests);
+
+        size_t iterations = 0;
+        for (const std::string& bytes : results) {
+            RootStats<action_type> stats = RootStats<action_type>::decode(bytes);
+            merge_root_stats(root, stats);
+            iterations += stats.iterations;
+        }
+        return iterations;
+    }
+} // namespace mcts
+
+#endif
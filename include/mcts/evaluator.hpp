@@ -0,0 +1,38 @@
+#ifndef MCTS_EVALUATOR_HPP
+#define MCTS_EVALUATOR_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+namespace mcts {
+
+    /// Leaf evaluators give the value of a batch of leaf states in one call (see MCTSNode::compute_evaluated):
+    ///   void operator()(const State* const* states, double* values, size_t n)
+    /// e.g. a learned value function that is most efficient on batches
+
+    /// stand-in evaluator for benchmarking batch sizes: `Value()(state)` for every state, plus
+    /// - `latency`: waited once per call, without using the CPU (e.g. the round trip to an accelerator)
+    /// - `cost_per_state`: spent busy for every state (e.g. inference on the CPU)
+    template <typename Value>
+    struct SimulatedEvaluator {
+        std::chrono::microseconds latency{0}, cost_per_state{0};
+        size_t calls = 0, states = 0;
+
+        template <typename State>
+        void operator()(const State* const* leaves, double* values, size_t n)
+        {
+            if (latency.count() > 0)
+                std::this_thread::sleep_for(latency);
+            auto busy_until = std::chrono::steady_clock::now() + cost_per_state * n;
+            for (size_t i = 0; i < n; i++)
+                values[i] = Value()(*leaves[i]);
+            while (std::chrono::steady_clock::now() < busy_until)
+                ;
+            calls++;
+            states += n;
+        }
+    };
+} // namespace mcts
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef MCTS_INDEX_HPP
+#define MCTS_INDEX_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#include <mcts/traits.hpp>
+
+namespace mcts {
+
+    /// opt-in hashed lookup of the children of a node (Action) or of an action (State):
+    /// specialize with `static size_t hash(const T& value)`, equal values must hash equally
+    template <typename T>
+    struct child_hash {
+    };
+
+    /// child_hash through std::hash, e.g.:
+    /// template <> struct mcts::child_hash<double> : mcts::std_child_hash<double> {};
+    template <typename T>
+    struct std_child_hash {
+        static size_t hash(const T& value)
+        {
+            return std::hash<T>()(value);
+        }
+    };
+
+    template <typename T, typename = void>
+    struct has_child_hash : std::false_type {
+    };
+
+    template <typename T>
+    struct has_child_hash<T, void_t<decltype(child_hash<T>::hash(std::declval<const T&>()))>> : std::true_type {
+    };
+
+    /// Lookup of children by value
+    /// - linear scan by default
+    /// - hash -> position index when child_hash<Key> is specialized (O(1) on average)
+    /// `project(child)` gives the value compared (with operator==) to the key
+    template <typename Key, bool Hashed = has_child_hash<Key>::value>
+    class ChildIndex {
+    public:
+        template <typename Children, typename Project>
+        auto find(Children& children, const Key& key, Project project) const -> decltype(children.begin())
+        {
+            return std::find_if(children.begin(), children.end(), [&](const typename Children::value_type& c) { return project(c) == key; });
+        }
+
+        void insert(const Key&, size_t) {}
+
+        template <typename Children, typename Project>
+        void rebuild(const Children&, Project)
+        {
+        }
+    };
+
+    template <typename Key>
+    class ChildIndex<Key, true> {
+    public:
+        template <typename Children, typename Project>
+        auto find(Children& children, const Key& key, Project project) const -> decltype(children.begin())
+        {
+            auto range = _positions.equal_range(child_hash<Key>::hash(key));
+            for (auto it = range.first; it != range.second; ++it) {
+                if (project(children[it->second]) == key)
+                    return children.begin() + it->second;
+            }
+            return children.end();
+        }
+
+        void insert(const Key& key, size_t position)
+        {
+            _positions.emplace(child_hash<Key>::hash(key), position);
+        }
+
+        /// after children were removed (positions shifted)
+        template <typename Children, typename Project>
+        void rebuild(const Children& children, Project project)
+        {
+            _positions.clear();
+            for (size_t i = 0; i < children.size(); i++)
+                insert(project(children[i]), i);
+        }
+
+    protected:
+        std::unordered_multimap<size_t, size_t> _positions;
+    };
+} // namespace mcts
+
+#endif
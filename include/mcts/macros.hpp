@@ -16,7 +16,11 @@
     static Type Name() { return _##Name; } \
     static void set_##Name(const Type& v) { _##Name = v; }
 
-#define MCTS_DECLARE_DYN_PARAM(Type, Namespace, Name) Type Namespace::_##Name;
+/// the definition of a MCTS_DYN_PARAM (value-initialized)
+#define MCTS_DECLARE_DYN_PARAM(Type, Namespace, Name) Type Namespace::_##Name{};
+
+/// the definition of a MCTS_DYN_PARAM with a default value (e.g. for sweeps and tune())
+#define MCTS_DECLARE_DYN_PARAM_DEFAULT(Type, Namespace, Name, Value) Type Namespace::_##Name{Value};
 
 #define __VA_NARG__(...) (__VA_NARG_(_0, ##__VA_ARGS__, __RSEQ_N()) - 1)
 #define __VA_NARG_(...) __VA_ARG_N(__VA_ARGS__)
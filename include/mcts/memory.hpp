@@ -0,0 +1,739 @@
+#ifndef MCTS_MEMORY_HPP
+#define MCTS_MEMORY_HPP
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mcts/parallel.hpp>
+#include <mcts/stats.hpp>
+#include <mcts/traits.hpp>
+
+namespace mcts {
+
+    /// non-owning handle: a shared_ptr without control block
+    /// (copying it never touches a reference count, the pointee must outlive it)
+    template <typename T>
+    std::shared_ptr<T> make_ref(T* p)
+    {
+        return std::shared_ptr<T>(std::shared_ptr<T>(), p);
+    }
+
+    /// Slab allocator for tree storage
+    /// - small blocks are served from 16-byte size classes, bigger ones from power-of-two classes
+    /// - freed blocks are recycled through per-class free lists (e.g. when a children vector grows)
+    /// - destructors are only recorded for objects that need them;
+    ///   release() runs those and then drops all slabs at once
+    /// - allocation is thread-safe (a shared tree may grow from several threads)
+    class Arena {
+    public:
+        static constexpr size_t alignment = 16;
+
+        explicit Arena(size_t slab_size = size_t(1) << 20) : _slab_size(slab_size), _cur(nullptr), _end(nullptr), _finalizers(nullptr), _reserved(0), _allocated(0)
+        {
+            _free.fill(nullptr);
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        ~Arena()
+        {
+            release();
+        }
+
+        void* allocate(size_t bytes)
+        {
+            std::lock_guard<par::spin_lock> lock(_lock);
+            return _allocate(bytes);
+        }
+
+        void deallocate(void* p, size_t bytes)
+        {
+            std::lock_guard<par::spin_lock> lock(_lock);
+            _deallocate(p, bytes);
+        }
+
+        /// construct a T inside the arena; with Finalize = false the destructor is never run
+        /// (only valid when everything T owns lives in this arena as well)
+        template <typename T, bool Finalize = !std::is_trivially_destructible<T>::value, typename... Args>
+        T* create(Args&&... args)
+        {
+            static_assert(alignof(T) <= alignment, "Arena: over-aligned types are not supported");
+            if (!Finalize)
+                return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+
+            void* mem = allocate(sizeof(T) + _header);
+            T* p = new (static_cast<char*>(mem) + _header) T(std::forward<Args>(args)...);
+
+            std::lock_guard<par::spin_lock> lock(_lock);
+            Finalizer* f = static_cast<Finalizer*>(mem);
+            f->destroy = [](void* obj) { static_cast<T*>(obj)->~T(); };
+            f->prev = nullptr;
+            f->next = _finalizers;
+            if (_finalizers)
+                _finalizers->prev = f;
+            _finalizers = f;
+            return p;
+        }
+
+        /// destroy an object created with create<T, Finalize>() and recycle its storage
+        template <typename T, bool Finalize = !std::is_trivially_destructible<T>::value>
+        void destroy(T* p)
+        {
+            if (p == nullptr)
+                return;
+            p->~T();
+            if (!Finalize) {
+                deallocate(p, sizeof(T));
+                return;
+            }
+
+            std::lock_guard<par::spin_lock> lock(_lock);
+            Finalizer* f = reinterpret_cast<Finalizer*>(reinterpret_cast<char*>(p) - _header);
+            if (f->prev)
+                f->prev->next = f->next;
+            else
+                _finalizers = f->next;
+            if (f->next)
+                f->next->prev = f->prev;
+            _deallocate(f, sizeof(T) + _header);
+        }
+
+        /// run the recorded destructors and give all the memory back
+        void release()
+        {
+            for (Finalizer* f = _finalizers; f != nullptr; f = f->next)
+                f->destroy(reinterpret_cast<char*>(f) + _header);
+            _finalizers = nullptr;
+
+            for (void* s : _slabs)
+                ::operator delete(s);
+            _slabs.clear();
+            _free.fill(nullptr);
+            _cur = _end = nullptr;
+            _reserved = _allocated = 0;
+        }
+
+        /// bytes obtained from the system
+        size_t bytes_reserved() const
+        {
+            return _reserved;
+        }
+
+        /// bytes currently handed out (rounded to size classes)
+        size_t bytes_allocated() const
+        {
+            return _allocated;
+        }
+
+    protected:
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        struct Finalizer {
+            void (*destroy)(void*);
+            Finalizer* prev;
+            Finalizer* next;
+        };
+
+        static constexpr size_t _header = (sizeof(Finalizer) + alignment - 1) / alignment * alignment;
+        static constexpr size_t _small_limit = 1024;
+        static constexpr size_t _small_classes = _small_limit / alignment;
+
+        size_t _slab_size;
+        char *_cur, *_end;
+        std::vector<void*> _slabs;
+        std::array<FreeBlock*, _small_classes + 64> _free;
+        Finalizer* _finalizers;
+        // written under the lock, read at any time (see MCTSNode::memory_usage)
+        par::relaxed_atomic<size_t> _reserved, _allocated;
+        par::spin_lock _lock;
+
+        void* _allocate(size_t bytes)
+        {
+            size_t c = _class(bytes);
+            size_t size = _class_size(c);
+            _allocated += size;
+
+            if (_free[c] != nullptr) {
+                FreeBlock* b = _free[c];
+                _free[c] = b->next;
+                return b;
+            }
+
+            if (size > _slab_size / 2)
+                return _new_slab(size);
+
+            if (_cur == nullptr || size_t(_end - _cur) < size) {
+                _cur = static_cast<char*>(_new_slab(_slab_size));
+                _end = _cur + _slab_size;
+            }
+
+            void* p = _cur;
+            _cur += size;
+            return p;
+        }
+
+        void _deallocate(void* p, size_t bytes)
+        {
+            if (p == nullptr)
+                return;
+            size_t c = _class(bytes);
+            _allocated -= _class_size(c);
+            FreeBlock* b = static_cast<FreeBlock*>(p);
+            b->next = _free[c];
+            _free[c] = b;
+        }
+
+        static size_t _class(size_t bytes)
+        {
+            if (bytes <= _small_limit)
+                return (std::max(bytes, size_t(1)) + alignment - 1) / alignment - 1;
+            size_t k = 0;
+            while ((_small_limit << (k + 1)) < bytes)
+                k++;
+            return _small_classes + k;
+        }
+
+        static size_t _class_size(size_t c)
+        {
+            if (c < _small_classes)
+                return (c + 1) * alignment;
+            return _small_limit << (c - _small_classes + 1);
+        }
+
+        void* _new_slab(size_t bytes)
+        {
+            void* s = ::operator new(bytes);
+            _slabs.push_back(s);
+            _reserved += bytes;
+            return s;
+        }
+    };
+
+    /// std-compatible allocator drawing from an Arena
+    template <typename T>
+    class ArenaAllocator {
+    public:
+        using value_type = T;
+
+        ArenaAllocator(Arena* arena) : _arena(arena) {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(_arena->allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            _arena->deallocate(p, n * sizeof(T));
+        }
+
+        Arena* arena() const
+        {
+            return _arena;
+        }
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const
+        {
+            return _arena == other.arena();
+        }
+
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const
+        {
+            return _arena != other.arena();
+        }
+
+    protected:
+        Arena* _arena;
+    };
+
+    /// Ping-pong pair of in-place State slots for allocation-free rollouts
+    /// - each move() writes the successor into the slot that does not hold `from`
+    /// - uses State::move_into when available, otherwise rebuilds the slot from State::move
+    template <typename State>
+    class ScratchStates {
+    public:
+        ScratchStates() : _slots{nullptr, nullptr}, _next(0) {}
+
+        ScratchStates(const ScratchStates&) = delete;
+        ScratchStates& operator=(const ScratchStates&) = delete;
+
+        ~ScratchStates()
+        {
+            clear();
+        }
+
+        template <typename Action>
+        const State& move(const State& from, const Action& action)
+        {
+            State*& slot = _slots[_next];
+            assert(slot != &from);
+            _write(slot, _buffers[_next], from, action, has_move_into<State, Action>());
+            _next ^= 1;
+            return *slot;
+        }
+
+        void clear()
+        {
+            for (size_t i = 0; i < 2; i++) {
+                if (_slots[i])
+                    _slots[i]->~State();
+                _slots[i] = nullptr;
+            }
+            _next = 0;
+        }
+
+    protected:
+        using buffer_type = typename std::aligned_storage<sizeof(State), alignof(State)>::type;
+
+        buffer_type _buffers[2];
+        State* _slots[2];
+        size_t _next;
+
+        template <typename Action>
+        static void _write(State*& slot, buffer_type& buffer, const State& from, const Action& action, std::true_type)
+        {
+            if (slot == nullptr)
+                slot = new (&buffer) State(from);
+            from.move_into(action, *slot);
+        }
+
+        template <typename Action>
+        static void _write(State*& slot, buffer_type& buffer, const State& from, const Action& action, std::false_type)
+        {
+            if (slot != nullptr)
+                slot->~State();
+            slot = nullptr;
+            slot = new (&buffer) State(from.move(action));
+        }
+    };
+
+    /// Per-thread lanes for rollouts stepped together through State::move_batch
+    /// (they only grow: no allocation once they reached the widest batch)
+    /// - every lane has two state slots, `from` and `to` point into them and are swapped after each step
+    /// - lanes are compacted when their rollout ends: the first `active` entries are the running ones
+    template <typename State, typename Action>
+    struct BatchScratch {
+        std::vector<State> slots;
+        std::vector<const State*> from;
+        std::vector<State*> to;
+        std::vector<Action> actions;
+        std::vector<double> rewards, returns;
+        std::vector<size_t> lanes, steps;
+        std::unique_ptr<bool[]> terminal;
+        size_t capacity = 0;
+
+        /// `n` lanes, all starting from `state`
+        void reset(const State& state, size_t n)
+        {
+            // states are copy-constructed only: they need not be assignable
+            slots.clear();
+            for (size_t i = 0; i < 2 * n; i++)
+                slots.push_back(state);
+            from.resize(n);
+            to.resize(n);
+            actions.resize(n);
+            rewards.resize(n);
+            returns.assign(n, 0.0);
+            lanes.resize(n);
+            steps.assign(n, 0);
+            if (capacity < n) {
+                terminal.reset(new bool[n]);
+                capacity = n;
+            }
+            for (size_t i = 0; i < n; i++) {
+                from[i] = &slots[2 * i];
+                to[i] = &slots[2 * i + 1];
+                lanes[i] = i;
+            }
+        }
+
+        static BatchScratch& local()
+        {
+            static thread_local BatchScratch scratch;
+            return scratch;
+        }
+    };
+
+    /// per-thread structure-of-arrays buffers for batched selection among the children of a node
+    /// (they only grow: no allocation once they reached the widest node)
+    struct SelectionScratch {
+        std::vector<double> values, visits, scores;
+
+        void resize(size_t n)
+        {
+            if (values.size() < n) {
+                values.resize(n);
+                visits.resize(n);
+                scores.resize(n);
+            }
+        }
+
+        static SelectionScratch& local()
+        {
+            static thread_local SelectionScratch scratch;
+            return scratch;
+        }
+    };
+
+    /// Per-thread buffer for the path of an iteration, handed back when the object goes out of scope
+    /// (the buffers only grow: no allocation once they reached the tree depth)
+    /// - one buffer per iteration running on the thread: a thread waiting inside par:: may pick up another iteration
+    template <typename Step>
+    class PathScratch {
+    public:
+        PathScratch() : _pool(_local()), _path(_pool.acquire()) {}
+
+        PathScratch(const PathScratch&) = delete;
+        PathScratch& operator=(const PathScratch&) = delete;
+
+        ~PathScratch()
+        {
+            _pool.used--;
+        }
+
+        std::vector<Step>& path()
+        {
+            return _path;
+        }
+
+    protected:
+        struct pool {
+            std::vector<std::unique_ptr<std::vector<Step>>> paths;
+            size_t used = 0;
+
+            std::vector<Step>& acquire()
+            {
+                if (used == paths.size())
+                    paths.emplace_back(new std::vector<Step>());
+                std::vector<Step>& path = *paths[used++];
+                path.clear();
+                return path;
+            }
+        };
+
+        pool& _pool;
+        std::vector<Step>& _path;
+
+        static pool& _local()
+        {
+            static thread_local pool p;
+            return p;
+        }
+    };
+
+    /// tree-wide counters, shared by all the nodes of a tree
+    struct TreeUsage {
+        par::relaxed_atomic<size_t> nodes, actions;
+    };
+
+    /// what a tree does once it reached its memory budget
+    enum class MemoryPolicy {
+        /// keep searching the existing tree: no new actions, outcomes are sampled among the known ones
+        stop_expanding,
+        /// drop the least visited subtrees and recycle their storage
+        /// (falls back to stop_expanding during shared-tree searches, and when nodes are shared, e.g. transpositions)
+        prune
+    };
+
+    /// memory cap of a tree, checked at every iteration (0: no limit)
+    struct MemoryBudget {
+        size_t max_nodes = 0;
+        size_t max_bytes = 0;
+        MemoryPolicy policy = MemoryPolicy::prune;
+        /// pruning goes that far below the budget, so that it does not run at every iteration
+        double prune_fraction = 0.2;
+
+        /// the share of one of `parts` trees grown side by side (e.g. root-parallel workers)
+        MemoryBudget split(size_t parts) const
+        {
+            MemoryBudget share = *this;
+            parts = std::max(parts, size_t(1));
+            if (max_nodes > 0)
+                share.max_nodes = std::max(max_nodes / parts, size_t(1));
+            if (max_bytes > 0)
+                share.max_bytes = std::max(max_bytes / parts, size_t(1));
+            return share;
+        }
+    };
+
+    /// search-wide constants, stored once per tree instead of in every node
+    struct SearchSettings {
+        size_t rollout_depth = 1000;
+        double gamma = 0.9;
+        MemoryBudget memory;
+    };
+
+    /// state of a node held through a (possibly reference-counted) pointer
+    template <typename State, typename Storage>
+    class PointerState {
+    public:
+        PointerState(const typename Storage::context& ctx, const State& state) : _ptr(Storage::template make<State>(ctx, state)) {}
+
+        State& operator*() const
+        {
+            return *_ptr;
+        }
+
+        State* operator->() const
+        {
+            return _ptr.get();
+        }
+
+        State* get() const
+        {
+            return _ptr.get();
+        }
+
+        std::shared_ptr<State> ptr() const
+        {
+            return _ptr;
+        }
+
+    protected:
+        std::shared_ptr<State> _ptr;
+    };
+
+    /// state of a node stored inside the node (one indirection less per visit)
+    /// ptr() is a non-owning handle, valid as long as the node
+    template <typename State>
+    class InlineState {
+    public:
+        template <typename Context>
+        InlineState(const Context&, const State& state) : _state(state) {}
+
+        State& operator*() const
+        {
+            return _state;
+        }
+
+        State* operator->() const
+        {
+            return &_state;
+        }
+
+        State* get() const
+        {
+            return &_state;
+        }
+
+        std::shared_ptr<State> ptr() const
+        {
+            return make_ref(&_state);
+        }
+
+    protected:
+        mutable State _state;
+    };
+
+    /// per-tree objects of optional features (e.g. a transposition table), created on first use
+    class TreeSlots {
+    public:
+        template <typename T, typename... Args>
+        T& get(Args&&... args)
+        {
+            std::lock_guard<par::spin_lock> lock(_lock);
+            const void* id = _id<T>();
+            for (const auto& slot : _slots) {
+                if (slot.first == id)
+                    return *static_cast<T*>(slot.second.get());
+            }
+
+            std::shared_ptr<T> object = std::make_shared<T>(std::forward<Args>(args)...);
+            _slots.emplace_back(id, object);
+            return *object;
+        }
+
+    protected:
+        std::vector<std::pair<const void*, std::shared_ptr<void>>> _slots;
+        par::spin_lock _lock;
+
+        template <typename T>
+        static const void* _id()
+        {
+            static const char id = 0;
+            return &id;
+        }
+    };
+
+    /// Default tree storage: every node, action and state is its own reference-counted heap object
+    struct SharedStorage {
+        // nodes can be handed over between trees (see MCTSNode::reroot)
+        static constexpr bool reference_counted = true;
+
+        struct tree {
+            TreeUsage usage;
+            SearchSettings settings;
+            SearchStats stats;
+            TreeSlots slots;
+        };
+
+        class context {
+        public:
+            context() : _tree(std::make_shared<tree>()) {}
+
+            context child() const
+            {
+                return *this;
+            }
+
+            TreeUsage& usage() const
+            {
+                return _tree->usage;
+            }
+
+            SearchSettings& settings() const
+            {
+                return _tree->settings;
+            }
+
+            SearchStats& stats() const
+            {
+                return _tree->stats;
+            }
+
+            TreeSlots& slots() const
+            {
+                return _tree->slots;
+            }
+
+        protected:
+            std::shared_ptr<tree> _tree;
+        };
+
+        template <typename T>
+        using vector = std::vector<T>;
+
+        template <typename T>
+        static vector<T> make_vector(const context&)
+        {
+            return vector<T>();
+        }
+
+        template <typename T, bool Finalize = true, typename... Args>
+        static std::shared_ptr<T> make(const context&, Args&&... args)
+        {
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        }
+
+        /// objects are released with their last reference
+        template <typename T, bool Finalize = true>
+        static void destroy(const context&, const std::shared_ptr<T>&)
+        {
+        }
+
+        // states stay shared: state() may be kept after the node is gone
+        template <typename State>
+        using state = PointerState<State, SharedStorage>;
+    };
+
+    /// Arena tree storage: the whole tree lives in the Arena owned by its root
+    /// - links are non-owning handles (no allocator call and no reference counting per node)
+    /// - destroying the root releases the tree in bulk
+    /// - handles obtained from the tree must not outlive the root
+    struct ArenaStorage {
+        static constexpr bool reference_counted = false;
+
+        // slots are declared last so that they are destroyed before the arena they may refer to
+        struct tree {
+            Arena arena;
+            TreeUsage usage;
+            SearchSettings settings;
+            SearchStats stats;
+            TreeSlots slots;
+
+            // the recorded destructors may still update the counters
+            ~tree()
+            {
+                arena.release();
+            }
+        };
+
+        class context {
+        public:
+            context() : _owner(new tree()), _tree(_owner.get()) {}
+
+            context child() const
+            {
+                return context(_tree);
+            }
+
+            Arena* arena() const
+            {
+                return &_tree->arena;
+            }
+
+            TreeUsage& usage() const
+            {
+                return _tree->usage;
+            }
+
+            SearchSettings& settings() const
+            {
+                return _tree->settings;
+            }
+
+            SearchStats& stats() const
+            {
+                return _tree->stats;
+            }
+
+            TreeSlots& slots() const
+            {
+                return _tree->slots;
+            }
+
+        protected:
+            // only set in the root
+            std::unique_ptr<tree> _owner;
+            tree* _tree;
+
+            explicit context(tree* t) : _tree(t) {}
+        };
+
+        template <typename T>
+        using vector = std::vector<T, ArenaAllocator<T>>;
+
+        template <typename T>
+        static vector<T> make_vector(const context& ctx)
+        {
+            return vector<T>(ArenaAllocator<T>(ctx.arena()));
+        }
+
+        template <typename T, bool Finalize = !std::is_trivially_destructible<T>::value, typename... Args>
+        static std::shared_ptr<T> make(const context& ctx, Args&&... args)
+        {
+            return make_ref(ctx.arena()->template create<T, Finalize>(std::forward<Args>(args)...));
+        }
+
+        /// destroy an object made with make<T, Finalize>() and recycle its memory (no handle to it may be left)
+        template <typename T, bool Finalize = !std::is_trivially_destructible<T>::value>
+        static void destroy(const context& ctx, const std::shared_ptr<T>& p)
+        {
+            ctx.arena()->template destroy<T, Finalize>(p.get());
+        }
+
+        /// states up to this size are stored inside their node
+        static constexpr size_t inline_state_size = 64;
+
+        template <typename State>
+        using state = typename std::conditional<(sizeof(State) <= inline_state_size), InlineState<State>, PointerState<State, ArenaStorage>>::type;
+    };
+} // namespace mcts
+
+#endif
@@ -2,8 +2,26 @@
 #define MCTS_PARALLEL_HPP
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
 #ifdef USE_TBB
 #include <tbb/blocked_range.h>
 #include <tbb/concurrent_vector.h>
@@ -12,7 +30,11 @@
 #include <tbb/parallel_invoke.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/parallel_sort.h>
-#ifndef USE_TBB_ONEAPI
+#ifdef USE_TBB_ONEAPI
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+#else
 #include <tbb/task_scheduler_init.h>
 #endif
 #endif
@@ -44,18 +66,526 @@ namespace mcts {
 
 #endif
 
-#if (defined USE_TBB) && !(defined USE_TBB_ONEAPI)
+        /// @ingroup par_tools
+        /// execution context of the par:: helpers (see configure())
+        struct ExecutionConfig {
+            /// worker threads (0: one per hardware thread)
+            size_t threads = 0;
+            /// pin every worker thread to a core (Linux)
+            bool pin = false;
+            /// one group of workers per NUMA node, pinned to the node: spread() runs task i on node i % nodes
+            /// (with legacy TBB, spread() then runs on its own std::threads; loop() and `pin` ignore the nodes)
+            bool numa = false;
+        };
+
+        namespace detail {
+            // "0-3,8-11" -> 0 1 2 3 8 9 10 11
+            inline std::vector<int> parse_cpulist(const std::string& list)
+            {
+                std::vector<int> cpus;
+                std::stringstream ranges(list);
+                std::string range;
+                while (std::getline(ranges, range, ',')) {
+                    if (range.empty())
+                        continue;
+                    size_t dash = range.find('-');
+                    int first = std::stoi(range.substr(0, dash));
+                    int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+                    for (int c = first; c <= last; c++)
+                        cpus.push_back(c);
+                }
+                return cpus;
+            }
+
+            // cpus of every NUMA node (a single node with all the cpus if the topology is not available)
+            inline std::vector<std::vector<int>> detect_numa_nodes()
+            {
+                std::vector<std::vector<int>> nodes;
+                for (int n = 0;; n++) {
+                    std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+                    if (!in)
+                        break;
+                    std::string list;
+                    std::getline(in, list);
+                    std::vector<int> cpus = parse_cpulist(list);
+                    if (!cpus.empty())
+                        nodes.push_back(cpus);
+                }
+                if (nodes.empty()) {
+                    nodes.emplace_back();
+                    for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); c++)
+                        nodes.back().push_back(int(c));
+                }
+                return nodes;
+            }
+
+            inline void pin_current_thread(const std::vector<int>& cpus)
+            {
+#ifdef __linux__
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int c : cpus)
+                    CPU_SET(c, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+                (void)cpus;
+#endif
+            }
+
+#if (defined USE_TBB) && (defined USE_TBB_ONEAPI)
+            // pins the worker threads joining an arena: to one core each, or anywhere on `cpus`
+            class pinning_observer : public tbb::task_scheduler_observer {
+            public:
+                pinning_observer(tbb::task_arena& arena, const std::vector<int>& cpus, bool per_core) : tbb::task_scheduler_observer(arena), _cpus(cpus), _per_core(per_core)
+                {
+                    observe(true);
+                }
+
+                ~pinning_observer()
+                {
+                    observe(false);
+                }
+
+                void on_scheduler_entry(bool worker) override
+                {
+                    // threads entering from outside (e.g. main) keep their affinity
+                    if (!worker)
+                        return;
+                    if (_per_core)
+                        pin_current_thread({_cpus[size_t(tbb::this_task_arena::current_thread_index()) % _cpus.size()]});
+                    else
+                        pin_current_thread(_cpus);
+                }
+
+            protected:
+                std::vector<int> _cpus;
+                bool _per_core;
+            };
+#endif
+
+            // set while a std::thread worker runs a loop body: nested loops then run inline
+            inline bool& in_worker()
+            {
+                static thread_local bool flag = false;
+                return flag;
+            }
+
+#if !(defined USE_TBB)
+            inline long process_id()
+            {
+#ifdef __linux__
+                return long(::getpid());
+#else
+                return 0;
+#endif
+            }
+
+            // std::thread fallback: the worker threads are started once and wait for the next loop,
+            // instead of being created and joined by every loop
+            class thread_pool {
+            public:
+                // worker t is pinned to cpus[(t + 1) % cpus.size()] if `pin` (the caller being the first one)
+                thread_pool(size_t workers, bool pin, const std::vector<int>& cpus) : _pid(process_id())
+                {
+                    for (size_t t = 0; t < workers; t++) {
+                        _threads.emplace_back([this, t, pin, cpus]() {
+                            if (pin)
+                                pin_current_thread({cpus[(t + 1) % cpus.size()]});
+                            _work(t);
+                        });
+                    }
+                }
+
+                ~thread_pool()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _stop = true;
+                    }
+                    _wake.notify_all();
+                    for (auto& t : _threads)
+                        t.join();
+                }
+
+                size_t size() const
+                {
+                    return _threads.size();
+                }
+
+                // the threads do not survive a fork(): a child process cannot use (nor join) its parent's pool
+                bool owned() const
+                {
+                    return _pid == process_id();
+                }
+
+                // runs `job` on `helpers` workers and on the calling thread, returns once all of them are done
+                // (one job at a time); the first exception thrown by `job` is rethrown here
+                void run(size_t helpers, const std::function<void()>& job)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _job = &job;
+                        _helpers = std::min(helpers, _threads.size());
+                        _running = _helpers;
+                        _generation++;
+                    }
+                    _wake.notify_all();
+                    // the workers use `job` until they are done, even if it throws here
+                    std::exception_ptr error = _call(job);
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _done.wait(lock, [this]() { return _running == 0; });
+                    _job = nullptr;
+                    if (!error)
+                        error = _error;
+                    _error = nullptr;
+                    if (error)
+                        std::rethrow_exception(error);
+                }
+
+            protected:
+                std::vector<std::thread> _threads;
+                std::mutex _mutex;
+                std::condition_variable _wake, _done;
+                const std::function<void()>* _job = nullptr;
+                size_t _helpers = 0, _running = 0, _generation = 0;
+                std::exception_ptr _error;
+                bool _stop = false;
+                long _pid;
+
+                // nested loops run inline meanwhile
+                static std::exception_ptr _call(const std::function<void()>& job)
+                {
+                    std::exception_ptr error;
+                    in_worker() = true;
+                    try {
+                        job();
+                    }
+                    catch (...) {
+                        error = std::current_exception();
+                    }
+                    in_worker() = false;
+                    return error;
+                }
+
+                void _work(size_t t)
+                {
+                    size_t seen = 0;
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    while (true) {
+                        _wake.wait(lock, [&]() { return _stop || _generation != seen; });
+                        if (_stop)
+                            return;
+                        seen = _generation;
+                        // the job of this generation only needs the first `_helpers` workers
+                        if (t >= _helpers)
+                            continue;
+                        const std::function<void()>& job = *_job;
+                        lock.unlock();
+                        std::exception_ptr error = _call(job);
+                        lock.lock();
+                        if (error && !_error)
+                            _error = error;
+                        if (--_running == 0)
+                            _done.notify_one();
+                    }
+                }
+            };
+#endif
+
+            struct execution_state {
+                ExecutionConfig config;
+                size_t threads = 1;
+                // cpus of the NUMA nodes in use (a single group without ExecutionConfig::numa)
+                std::vector<std::vector<int>> nodes;
+                // set once the context is built; `config_mutex` serializes building it
+                std::atomic<bool> configured{false};
+                std::mutex config_mutex;
+#if (defined USE_TBB) && (defined USE_TBB_ONEAPI)
+                std::unique_ptr<tbb::global_control> control;
+                // one per node with numa, a single one with pin only
+                std::vector<std::unique_ptr<tbb::task_arena>> arenas;
+                std::vector<std::unique_ptr<pinning_observer>> observers;
+#elif defined(USE_TBB)
+                std::unique_ptr<tbb::task_scheduler_init> init;
+#else
+                // started by the first loop that needs it; `pool_mutex` is held by the loop using it
+                std::unique_ptr<thread_pool> pool;
+                std::mutex pool_mutex;
+#endif
+            };
+
+            inline execution_state& raw_state()
+            {
+                static execution_state state;
+                return state;
+            }
+
+#if !(defined USE_TBB)
+            inline void reset_pool(execution_state& s)
+            {
+                // a pool inherited through fork() has no threads to join here: it is left behind
+                if (s.pool && !s.pool->owned())
+                    s.pool.release();
+                s.pool.reset();
+            }
+#endif
+
+            // builds the context (config_mutex held)
+            inline void apply(execution_state& s, const ExecutionConfig& config)
+            {
+#if (defined USE_TBB) && (defined USE_TBB_ONEAPI)
+                s.observers.clear();
+                s.arenas.clear();
+                s.control.reset();
+#elif defined(USE_TBB)
+                s.init.reset();
+#else
+                reset_pool(s);
+#endif
+                s.config = config;
+                s.threads = config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+                s.nodes = detect_numa_nodes();
+                if (!config.numa) {
+                    std::vector<int> all;
+                    for (const auto& node : s.nodes)
+                        all.insert(all.end(), node.begin(), node.end());
+                    s.nodes.assign(1, all);
+                }
+
+#if (defined USE_TBB) && (defined USE_TBB_ONEAPI)
+                s.control.reset(new tbb::global_control(tbb::global_control::max_allowed_parallelism, s.threads));
+                if (config.numa || config.pin) {
+                    // the threads are shared out between the nodes
+                    size_t n = s.nodes.size();
+                    for (size_t k = 0; k < n; k++) {
+                        size_t share = std::max(size_t(1), s.threads / n + (k < s.threads % n ? 1 : 0));
+                        s.arenas.emplace_back(new tbb::task_arena(int(share)));
+                        s.arenas.back()->initialize();
+                        s.observers.emplace_back(new pinning_observer(*s.arenas.back(), s.nodes[k], config.pin));
+                    }
+                }
+#elif defined(USE_TBB)
+                s.init.reset(new tbb::task_scheduler_init(int(s.threads)));
+#endif
+                s.configured.store(true, std::memory_order_release);
+            }
+        } // namespace detail
+
+        /// @ingroup par_tools
+        /// (re)configure the execution context; no parallel work may run meanwhile
+        inline void configure(const ExecutionConfig& config)
+        {
+            detail::execution_state& s = detail::raw_state();
+            std::lock_guard<std::mutex> lock(s.config_mutex);
+            detail::apply(s, config);
+        }
+
+        namespace detail {
+            inline execution_state& state()
+            {
+                execution_state& s = raw_state();
+                // the first par:: calls of several threads may race to build the default context
+                if (!s.configured.load(std::memory_order_acquire)) {
+                    std::lock_guard<std::mutex> lock(s.config_mutex);
+                    if (!s.configured.load(std::memory_order_relaxed))
+                        apply(s, ExecutionConfig());
+                }
+                return s;
+            }
+
+            // runs f inside the configured arena (pinned threads), if any
+            template <typename F>
+            inline void execute(const F& f)
+            {
+#if (defined USE_TBB) && (defined USE_TBB_ONEAPI)
+                execution_state& s = state();
+                if (!s.config.numa && !s.arenas.empty()) {
+                    s.arenas[0]->execute(f);
+                    return;
+                }
+#endif
+                f();
+            }
+
+#if !(defined USE_TBB)
+            // std::thread fallback: up to `threads` threads (the caller and the pool workers) share out the indices
+            // - a loop started while another one holds the pool (from another thread) runs inline
+            template <typename F>
+            inline void thread_loop(size_t begin, size_t end, const F& f)
+            {
+                size_t n = (end > begin) ? end - begin : 0;
+                execution_state& s = state();
+                size_t workers = std::min(s.threads, n);
+                std::unique_lock<std::mutex> lock(s.pool_mutex, std::defer_lock);
+                if (workers <= 1 || in_worker() || !lock.try_lock()) {
+                    for (size_t i = begin; i < end; ++i)
+                        f(i);
+                    return;
+                }
+
+                if (!s.pool || !s.pool->owned()) {
+                    reset_pool(s);
+                    s.pool.reset(new thread_pool(s.threads - 1, s.config.pin, s.nodes[0]));
+                }
+
+                std::atomic<size_t> next(begin);
+                std::function<void()> body = [&]() {
+                    for (size_t i = next.fetch_add(1); i < end; i = next.fetch_add(1))
+                        f(i);
+                };
+                s.pool->run(workers - 1, body);
+            }
+#endif
+        } // namespace detail
+
+        /// @ingroup par_tools
+        /// configure the default execution context (every hardware thread), unless configure() was called
         inline void init()
         {
-            static tbb::task_scheduler_init init;
+            detail::state();
         }
-#else
+
         /// @ingroup par_tools
-        /// init TBB (if activated) for multi-core computing
-        void init()
+        /// number of worker threads of the execution context
+        inline size_t threads()
         {
+            return detail::state().threads;
         }
-#endif
+
+        /// @ingroup par_tools
+        /// number of NUMA nodes spread() places tasks on (1 unless configured with numa)
+        inline size_t nodes()
+        {
+            return detail::state().nodes.size();
+        }
+
+        /// @ingroup par_tools
+        /// statistic shared between threads: reads and plain writes are relaxed loads/stores
+        /// (as cheap as a plain value when single-threaded), fetch_add() is the atomic update
+        template <typename T>
+        class relaxed_atomic {
+        public:
+            relaxed_atomic(T v = T()) : _v(v) {}
+            relaxed_atomic(const relaxed_atomic& other) : _v(other.load()) {}
+
+            relaxed_atomic& operator=(const relaxed_atomic& other)
+            {
+                store(other.load());
+                return *this;
+            }
+
+            relaxed_atomic& operator=(T v)
+            {
+                store(v);
+                return *this;
+            }
+
+            operator T() const
+            {
+                return load();
+            }
+
+            T load() const
+            {
+                return _v.load(std::memory_order_relaxed);
+            }
+
+            void store(T v)
+            {
+                _v.store(v, std::memory_order_relaxed);
+            }
+
+            // single-writer updates (not atomic as a whole)
+            relaxed_atomic& operator+=(T v)
+            {
+                store(load() + v);
+                return *this;
+            }
+
+            relaxed_atomic& operator-=(T v)
+            {
+                store(load() - v);
+                return *this;
+            }
+
+            relaxed_atomic& operator++()
+            {
+                store(load() + T(1));
+                return *this;
+            }
+
+            T operator++(int)
+            {
+                T old = load();
+                store(old + T(1));
+                return old;
+            }
+
+            /// atomic read-modify-write, returns the previous value
+            T fetch_add(T v)
+            {
+                return _fetch_add(v, std::is_integral<T>());
+            }
+
+            T fetch_sub(T v)
+            {
+                return _fetch_sub(v, std::is_integral<T>());
+            }
+
+        protected:
+            std::atomic<T> _v;
+
+            T _fetch_add(T v, std::true_type)
+            {
+                return _v.fetch_add(v, std::memory_order_relaxed);
+            }
+
+            T _fetch_add(T v, std::false_type)
+            {
+                T old = load();
+                while (!_v.compare_exchange_weak(old, old + v, std::memory_order_relaxed))
+                    ;
+                return old;
+            }
+
+            T _fetch_sub(T v, std::true_type)
+            {
+                return _v.fetch_sub(v, std::memory_order_relaxed);
+            }
+
+            T _fetch_sub(T v, std::false_type)
+            {
+                return _fetch_add(-v, std::false_type());
+            }
+        };
+
+        /// @ingroup par_tools
+        /// lock for short critical sections (e.g. expanding a node of a shared tree)
+        class spin_lock {
+        public:
+            spin_lock() { _flag.clear(); }
+            spin_lock(const spin_lock&) = delete;
+            spin_lock& operator=(const spin_lock&) = delete;
+
+            void lock()
+            {
+                while (_flag.test_and_set(std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+
+            bool try_lock()
+            {
+                return !_flag.test_and_set(std::memory_order_acquire);
+            }
+
+            void unlock()
+            {
+                _flag.clear(std::memory_order_release);
+            }
+
+        protected:
+            std::atomic_flag _flag;
+        };
 
         ///@ingroup par_tools
         /// parallel for
@@ -63,14 +593,63 @@ namespace mcts {
         inline void loop(size_t begin, size_t end, const F& f)
         {
 #ifdef USE_TBB
-            tbb::parallel_for(size_t(begin), end, size_t(1), [&](size_t i) {
-                // clang-format off
-                f(i);
-                // clang-format on
+            detail::execute([&]() {
+                tbb::parallel_for(size_t(begin), end, size_t(1), [&](size_t i) {
+                    // clang-format off
+                    f(i);
+                    // clang-format on
+                });
             });
 #else
-            for (size_t i = begin; i < end; ++i)
-                f(i);
+            detail::thread_loop(begin, end, f);
+#endif
+        }
+
+        /// @ingroup par_tools
+        /// parallel for placing task i on NUMA node i % nodes() (memory allocated by the task is then local to it);
+        /// same as loop() unless configured with numa
+        template <typename F>
+        inline void spread(size_t begin, size_t end, const F& f)
+        {
+            const detail::execution_state& s = detail::state();
+            size_t nodes = s.nodes.size();
+            if (!s.config.numa || nodes <= 1 || end <= begin) {
+                loop(begin, end, f);
+                return;
+            }
+
+#if (defined USE_TBB) && (defined USE_TBB_ONEAPI)
+            // one thread per node enters the node's arena and runs its tasks there
+            auto on_node = [&](size_t k) {
+                detail::pin_current_thread(s.nodes[k]);
+                size_t tasks = (end - begin + nodes - 1 - k) / nodes;
+                s.arenas[k]->execute([&]() {
+                    tbb::parallel_for(size_t(0), tasks, size_t(1), [&](size_t j) {
+                        // clang-format off
+                        f(begin + k + j * nodes);
+                        // clang-format on
+                    });
+                });
+            };
+            std::vector<std::thread> threads;
+            for (size_t k = 0; k < nodes; k++)
+                threads.emplace_back(on_node, k);
+            for (auto& t : threads)
+                t.join();
+#else
+            // thread t runs the tasks i = t (mod workers) on node t % nodes, with workers a multiple of nodes
+            size_t workers = std::max(nodes, std::min(s.threads, end - begin) / nodes * nodes);
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < workers; t++) {
+                threads.emplace_back([&, t]() {
+                    detail::pin_current_thread(s.nodes[t % nodes]);
+                    detail::in_worker() = true;
+                    for (size_t i = begin + t; i < end; i += workers)
+                        f(i);
+                });
+            }
+            for (auto& t : threads)
+                t.join();
 #endif
         }
 
@@ -80,7 +659,7 @@ namespace mcts {
         inline void for_each(Iterator begin, Iterator end, const F& f)
         {
 #ifdef USE_TBB
-            tbb::parallel_for_each(begin, end, f);
+            detail::execute([&]() { tbb::parallel_for_each(begin, end, f); });
 #else
             for (Iterator i = begin; i != end; ++i)
                 f(*i);
@@ -111,8 +690,9 @@ namespace mcts {
             return p2;
                 // clang-format on
             };
-            return tbb::parallel_reduce(tbb::blocked_range<size_t>(0, num_steps), init,
-                body, joint);
+            T result = init;
+            detail::execute([&]() { result = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, num_steps), init, body, joint); });
+            return result;
 #else
             T current_max = init;
             for (size_t i = 0; i < num_steps; ++i) {
@@ -129,27 +709,30 @@ namespace mcts {
         inline void sort(T1 i1, T2 i2, T3 comp)
         {
 #ifdef USE_TBB
-            tbb::parallel_sort(i1, i2, comp);
+            detail::execute([&]() { tbb::parallel_sort(i1, i2, comp); });
 #else
             std::sort(i1, i2, comp);
 #endif
         }
 
+        /// @ingroup par_tools
+        /// run f in the background, without waiting for it (e.g. to release memory)
+        template <typename F>
+        inline void detach(F&& f)
+        {
+            std::thread(std::forward<F>(f)).detach();
+        }
+
         /// @ingroup par_tools
         /// replicate a function nb times
         template <typename F>
         inline void replicate(size_t nb, const F& f)
         {
-#ifdef USE_TBB
-            tbb::parallel_for(size_t(0), nb, size_t(1), [&](size_t i) {
+            loop(0, nb, [&](size_t) {
                 // clang-format off
                 f();
                 // clang-format on
             });
-#else
-            for (size_t i = 0; i < nb; ++i)
-                f();
-#endif
         }
     } // namespace par
 } // namespace mcts
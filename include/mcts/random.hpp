@@ -0,0 +1,289 @@
+#ifndef MCTS_RANDOM_HPP
+#define MCTS_RANDOM_HPP
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace mcts {
+    namespace rng {
+
+        /// @ingroup rng
+        /// xoshiro256** (Blackman & Vigna): 32 bytes of state, period 2^256 - 1
+        /// (a UniformRandomBitGenerator, so it also works with <random> distributions)
+        class Xoshiro256 {
+        public:
+            using result_type = uint64_t;
+
+            explicit Xoshiro256(uint64_t seed = 0x853c49e6748fea9bULL)
+            {
+                this->seed(seed);
+            }
+
+            /// the four words of state are expanded from `seed` with splitmix64
+            void seed(uint64_t seed)
+            {
+                for (size_t i = 0; i < 4; i++)
+                    _s[i] = _splitmix64(seed);
+                _has_gaussian = false;
+            }
+
+            static constexpr result_type min()
+            {
+                return 0;
+            }
+
+            static constexpr result_type max()
+            {
+                return std::numeric_limits<result_type>::max();
+            }
+
+            result_type operator()()
+            {
+                const uint64_t result = _rotate_left(_s[1] * 5, 7) * 9;
+                const uint64_t t = _s[1] << 17;
+
+                _s[2] ^= _s[0];
+                _s[3] ^= _s[1];
+                _s[1] ^= _s[2];
+                _s[0] ^= _s[3];
+                _s[2] ^= t;
+                _s[3] = _rotate_left(_s[3], 45);
+
+                return result;
+            }
+
+            /// advance by 2^128 steps: successive jumps give non-overlapping streams
+            void jump()
+            {
+                static const uint64_t polynomial[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+
+                uint64_t s[4] = {0, 0, 0, 0};
+                for (uint64_t word : polynomial) {
+                    for (size_t b = 0; b < 64; b++) {
+                        if (word & (uint64_t(1) << b)) {
+                            for (size_t i = 0; i < 4; i++)
+                                s[i] ^= _s[i];
+                        }
+                        (*this)();
+                    }
+                }
+                for (size_t i = 0; i < 4; i++)
+                    _s[i] = s[i];
+                _has_gaussian = false;
+            }
+
+            /// uniform in [0, 1)
+            double uniform()
+            {
+                return ((*this)() >> 11) * (1.0 / 9007199254740992.0);
+            }
+
+            /// uniform in [a, b)
+            double uniform(double a, double b)
+            {
+                return a + (b - a) * uniform();
+            }
+
+            /// uniform integer in [0, n), n > 0 (Lemire's multiply-shift, without modulo bias)
+            uint64_t below(uint64_t n)
+            {
+                unsigned __int128 m = static_cast<unsigned __int128>((*this)()) * n;
+                uint64_t low = static_cast<uint64_t>(m);
+                if (low < n) {
+                    uint64_t threshold = -n % n;
+                    while (low < threshold) {
+                        m = static_cast<unsigned __int128>((*this)()) * n;
+                        low = static_cast<uint64_t>(m);
+                    }
+                }
+                return static_cast<uint64_t>(m >> 64);
+            }
+
+            /// normal distribution (Marsaglia polar method, the second value is kept for the next call)
+            double gaussian(double mean = 0.0, double stddev = 1.0)
+            {
+                if (_has_gaussian) {
+                    _has_gaussian = false;
+                    return mean + stddev * _gaussian;
+                }
+
+                double u, v, s;
+                do {
+                    u = 2.0 * uniform() - 1.0;
+                    v = 2.0 * uniform() - 1.0;
+                    s = u * u + v * v;
+                } while (s >= 1.0 || s == 0.0);
+
+                double f = std::sqrt(-2.0 * std::log(s) / s);
+                _gaussian = v * f;
+                _has_gaussian = true;
+                return mean + stddev * u * f;
+            }
+
+            /// batch generation: fill [first, last) with uniform values in [0, 1)
+            template <typename Iterator>
+            void generate_uniform(Iterator first, Iterator last)
+            {
+                for (; first != last; ++first)
+                    *first = uniform();
+            }
+
+            /// batch generation: fill [first, last) with raw 64-bit values
+            template <typename Iterator>
+            void generate(Iterator first, Iterator last)
+            {
+                for (; first != last; ++first)
+                    *first = (*this)();
+            }
+
+        protected:
+            uint64_t _s[4];
+            double _gaussian;
+            bool _has_gaussian;
+
+            static uint64_t _rotate_left(uint64_t x, int k)
+            {
+                return (x << k) | (x >> (64 - k));
+            }
+
+            static uint64_t _splitmix64(uint64_t& x)
+            {
+                uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+        };
+
+        namespace detail {
+            struct global_seed {
+                std::atomic<uint64_t> seed{0x853c49e6748fea9bULL};
+                std::atomic<uint64_t> epoch{0};
+                std::atomic<size_t> threads{0};
+                // parallel calls that seeded worker streams (see next_salt())
+                std::atomic<uint64_t> calls{0};
+            };
+
+            inline global_seed& global()
+            {
+                static global_seed g;
+                return g;
+            }
+
+            struct thread_state {
+                Xoshiro256 generator;
+                uint64_t epoch = std::numeric_limits<uint64_t>::max();
+            };
+
+            inline thread_state& local()
+            {
+                static thread_local thread_state state;
+                return state;
+            }
+
+            // stream `stream` of the generator seeded with `seed`
+            inline void seed_stream(Xoshiro256& generator, uint64_t seed, size_t stream)
+            {
+                generator.seed(seed);
+                for (size_t i = 0; i < stream; i++)
+                    generator.jump();
+            }
+        } // namespace detail
+
+        /// @ingroup rng
+        /// seed of the per-thread generators; every thread is reseeded on its next draw
+        /// (the default seed is fixed: single-threaded runs are reproducible)
+        inline void seed(uint64_t seed)
+        {
+            detail::global_seed& g = detail::global();
+            g.seed = seed;
+            g.threads = 0;
+            g.calls = 0;
+            g.epoch++;
+        }
+
+        /// @ingroup rng
+        /// generator of the calling thread: threads get independent streams in the order they first draw
+        inline Xoshiro256& generator()
+        {
+            detail::thread_state& state = detail::local();
+            detail::global_seed& g = detail::global();
+            uint64_t epoch = g.epoch.load(std::memory_order_relaxed);
+            if (state.epoch != epoch) {
+                detail::seed_stream(state.generator, g.seed, g.threads.fetch_add(1));
+                state.epoch = epoch;
+            }
+            return state.generator;
+        }
+
+        /// @ingroup rng
+        /// salt of the worker streams of a new parallel call (see seed_worker): every call gets its own streams,
+        /// in a sequence that seed() starts again (runs stay reproducible)
+        inline uint64_t next_salt()
+        {
+            return detail::global().calls.fetch_add(1) + 1;
+        }
+
+        /// @ingroup rng
+        /// deterministic seeding: the calling thread continues with the stream of worker `worker`
+        /// (e.g. one per root-parallel tree) of the call salted with `salt`, whatever thread the worker
+        /// was scheduled on
+        inline void seed_worker(size_t worker, uint64_t salt = 0)
+        {
+            detail::thread_state& state = detail::local();
+            detail::global_seed& g = detail::global();
+            // worker streams come from another seed than the per-thread ones
+            detail::seed_stream(state.generator, g.seed ^ 0x5851f42d4c957f2dULL ^ (salt * 0x9e3779b97f4a7c15ULL), worker);
+            state.epoch = g.epoch.load(std::memory_order_relaxed);
+        }
+
+        /// @ingroup rng
+        /// keeps the generator of the calling thread across a parallel call that seeds its workers
+        /// (the calling thread may run one of them)
+        class GeneratorGuard {
+        public:
+            GeneratorGuard() : _saved(generator()) {}
+
+            ~GeneratorGuard()
+            {
+                generator() = _saved;
+            }
+
+        protected:
+            Xoshiro256 _saved;
+        };
+
+        /// @ingroup rng
+        /// uniform in [0, 1) from the generator of the calling thread
+        inline double uniform()
+        {
+            return generator().uniform();
+        }
+
+        /// @ingroup rng
+        /// uniform in [a, b) from the generator of the calling thread
+        inline double uniform(double a, double b)
+        {
+            return generator().uniform(a, b);
+        }
+
+        /// @ingroup rng
+        /// uniform integer in [0, n) from the generator of the calling thread
+        inline uint64_t below(uint64_t n)
+        {
+            return generator().below(n);
+        }
+
+        /// @ingroup rng
+        /// normal distribution from the generator of the calling thread
+        inline double gaussian(double mean = 0.0, double stddev = 1.0)
+        {
+            return generator().gaussian(mean, stddev);
+        }
+    } // namespace rng
+} // namespace mcts
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef MCTS_SAMPLER_HPP
+#define MCTS_SAMPLER_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+namespace mcts {
+
+    /// Sampling of the outcome nodes of an action in proportion to their visits
+    /// - Fenwick (binary indexed) tree over the visits: O(log n) sampling and updates
+    /// - built lazily on the first sample(), so that actions that are never sampled pay nothing;
+    ///   until then (or after invalidate()) push_back() and add() are no-ops
+    /// `Vector` is a vector of size_t (e.g. Storage::vector<size_t>)
+    template <typename Vector>
+    class VisitSampler {
+    public:
+        explicit VisitSampler(Vector tree) : _tree(std::move(tree)), _total(0), _valid(false) {}
+
+        bool valid() const
+        {
+            return _valid;
+        }
+
+        /// the visits changed behind our back (children removed, merged or loaded statistics):
+        /// rebuilt at the next sample()
+        void invalidate()
+        {
+            _valid = false;
+        }
+
+        size_t total() const
+        {
+            return _total;
+        }
+
+        /// a new child, with no visits yet
+        void push_back()
+        {
+            if (!_valid)
+                return;
+            // the new entry covers (i - lowbit(i), i]: the sum of its predecessors in that range
+            size_t i = _tree.size();
+            size_t low = i - (i & (~i + 1));
+            _tree.push_back(_prefix(i - 1) - _prefix(low));
+        }
+
+        /// `count` more visits for the child at `position`
+        void add(size_t position, size_t count)
+        {
+            if (!_valid)
+                return;
+            assert(position + 1 < _tree.size());
+            for (size_t i = position + 1; i < _tree.size(); i += i & (~i + 1))
+                _tree[i] += count;
+            _total += count;
+        }
+
+        /// rebuild from `weight(child)` in O(n)
+        template <typename Children, typename Weight>
+        void rebuild(const Children& children, Weight weight)
+        {
+            size_t n = children.size();
+            _tree.assign(n + 1, 0);
+            _total = 0;
+            for (size_t i = 1; i <= n; i++) {
+                size_t w = weight(children[i - 1]);
+                _tree[i] += w;
+                _total += w;
+                size_t parent = i + (i & (~i + 1));
+                if (parent <= n)
+                    _tree[parent] += _tree[i];
+            }
+            _valid = true;
+        }
+
+        /// the position p with prefix(p) <= r < prefix(p + 1), for r < total()
+        size_t find(size_t r) const
+        {
+            assert(_valid && r < _total);
+            size_t n = _tree.size() - 1;
+            size_t step = 1;
+            while (step * 2 <= n)
+                step *= 2;
+            size_t pos = 0;
+            for (; step > 0; step /= 2) {
+                if (pos + step <= n && _tree[pos + step] <= r) {
+                    pos += step;
+                    r -= _tree[pos];
+                }
+            }
+            return pos;
+        }
+
+    protected:
+        // 1-based: _tree[i] is the sum of the visits of the children (i - lowbit(i), i]
+        Vector _tree;
+        size_t _total;
+        bool _valid;
+
+        // sum of the visits of the first `i` children
+        size_t _prefix(size_t i) const
+        {
+            size_t sum = 0;
+            for (; i > 0; i -= i & (~i + 1))
+                sum += _tree[i];
+            return sum;
+        }
+    };
+} // namespace mcts
+
+#endif
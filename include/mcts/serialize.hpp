@@ -0,0 +1,613 @@
+#ifndef MCTS_SERIALIZE_HPP
+#define MCTS_SERIALIZE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MCTS_HAS_MMAP
+#endif
+
+namespace mcts {
+
+    /// bytes of a record being written (see serializer)
+    class BinaryWriter {
+    public:
+        void write_bytes(const void* data, size_t size)
+        {
+            _bytes.append(static_cast<const char*>(data), size);
+        }
+
+        template <typename T>
+        void write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "BinaryWriter::write: trivially copyable types only");
+            write_bytes(&value, sizeof(T));
+        }
+
+        const std::string& bytes() const
+        {
+            return _bytes;
+        }
+
+        void clear()
+        {
+            _bytes.clear();
+        }
+
+    protected:
+        std::string _bytes;
+    };
+
+    /// bounds-checked reads from a range of bytes (throws std::runtime_error past its end)
+    class BinaryReader {
+    public:
+        BinaryReader(const char* begin, const char* end) : _cur(begin), _end(end) {}
+
+        void read_bytes(void* data, size_t size)
+        {
+            if (size_t(_end - _cur) < size)
+                throw std::runtime_error("mcts: truncated tree snapshot");
+            std::memcpy(data, _cur, size);
+            _cur += size;
+        }
+
+        template <typename T>
+        T read()
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "BinaryReader::read: trivially copyable types only");
+            T value;
+            read_bytes(&value, sizeof(T));
+            return value;
+        }
+
+        const char* position() const
+        {
+            return _cur;
+        }
+
+    protected:
+        const char *_cur, *_end;
+    };
+
+    /// copies the bytes of a trivially copyable type
+    template <typename T>
+    struct trivial_serializer {
+        static void write(BinaryWriter& out, const T& value)
+        {
+            out.write(value);
+        }
+
+        static T read(BinaryReader& in)
+        {
+            return in.template read<T>();
+        }
+    };
+
+    /// a trivially copyable object (e.g. a reward function or a stopping criterion) sent to another process
+    /// (see distributed.hpp): its bytes are copied, so it may only hold plain values and pointers to code or static data
+    template <typename T>
+    void write_object(BinaryWriter& out, const T& object)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "write_object: trivially copyable types only (capture by value)");
+        out.write_bytes(&object, sizeof(T));
+    }
+
+    /// the copy of an object written by write_object (which need not be default constructible, e.g. a lambda)
+    template <typename T>
+    class ObjectCopy {
+    public:
+        explicit ObjectCopy(BinaryReader& in)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "ObjectCopy: trivially copyable types only");
+            in.read_bytes(&_storage, sizeof(T));
+        }
+
+        T& get()
+        {
+            return *reinterpret_cast<T*>(&_storage);
+        }
+
+    protected:
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+    };
+
+    /// (de)serialization of the states and actions of a tree, to specialize for user types:
+    ///   static void write(BinaryWriter& out, const T& value);
+    ///   static T read(BinaryReader& in);
+    /// arithmetic and enum types are handled by trivial_serializer
+    template <typename T, typename = void>
+    struct serializer {
+    };
+
+    template <typename T>
+    struct serializer<T, typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type> : trivial_serializer<T> {
+    };
+
+    /// Tree snapshot format (version 1), native byte order:
+    /// - header: "MCTSTREE", version (u32), byte-order mark 0x01020304 (u32), nodes (u64), actions (u64),
+    ///   rollout depth (u64), gamma (f64), offset of the root (u64), reserved (u64)
+    /// - node: visits (u64), depth (u64), actions (u32), state size (u32), state, offsets of the actions (u64 each)
+    /// - action: value (f64), squared value (f64), visits (u64), children (u32), action size (u32), action,
+    ///   offsets of the outcome nodes (u64 each)
+    /// Records are written children first, so every offset points backwards; a node reached along several paths
+    /// (transpositions) is written once.
+    namespace snapshot {
+        static constexpr char magic[8] = {'M', 'C', 'T', 'S', 'T', 'R', 'E', 'E'};
+        static constexpr uint32_t version = 1;
+        static constexpr uint32_t byte_order = 0x01020304;
+        static constexpr size_t header_size = 64;
+
+        struct Header {
+            uint64_t nodes, actions, rollout_depth;
+            double gamma;
+            uint64_t root;
+        };
+
+        template <typename Node>
+        using action_t = typename std::decay<decltype(std::declval<typename Node::action_type&>().action())>::type;
+    } // namespace snapshot
+
+    /// write the tree below `root` (every node, action and statistic) to `out`
+    template <typename Node>
+    void save_tree(const Node& root, std::ostream& out)
+    {
+        using state_type = typename Node::state_type;
+        using action_type = snapshot::action_t<Node>;
+
+        snapshot::Header header{0, 0, root.rollout_depth(), root.gamma(), 0};
+        char zeros[snapshot::header_size] = {};
+        out.write(zeros, snapshot::header_size);
+        uint64_t offset = snapshot::header_size;
+
+        BinaryWriter record, value;
+        auto flush = [&]() {
+            out.write(record.bytes().data(), record.bytes().size());
+            uint64_t at = offset;
+            offset += record.bytes().size();
+            record.clear();
+            return at;
+        };
+
+        // post-order (explicit stack: trees can be very deep)
+        std::unordered_map<const Node*, uint64_t> written;
+        std::vector<std::pair<const Node*, bool>> stack(1, std::make_pair(&root, false));
+        while (!stack.empty()) {
+            const Node* node = stack.back().first;
+            bool children_done = stack.back().second;
+            stack.pop_back();
+
+            if (!children_done) {
+                if (written.count(node))
+                    continue;
+                stack.emplace_back(node, true);
+                for (const auto& action : node->children()) {
+                    for (const auto& child : action->children()) {
+                        if (!written.count(child.get()))
+                            stack.emplace_back(child.get(), false);
+                    }
+                }
+                continue;
+            }
+            if (written.count(node))
+                continue;
+
+            std::vector<uint64_t> actions;
+            for (const auto& action : node->children()) {
+                value.clear();
+                serializer<action_type>::write(value, action->action());
+                record.write(double(action->value()));
+                record.write(double(action->squared_value()));
+                record.write(uint64_t(action->visits()));
+                record.write(uint32_t(action->children().size()));
+                record.write(uint32_t(value.bytes().size()));
+                record.write_bytes(value.bytes().data(), value.bytes().size());
+                for (const auto& child : action->children())
+                    record.write(written.at(child.get()));
+                actions.push_back(flush());
+                header.actions++;
+            }
+
+            value.clear();
+            serializer<state_type>::write(value, *(node->state()));
+            record.write(uint64_t(node->visits()));
+            record.write(uint64_t(node->depth()));
+            record.write(uint32_t(actions.size()));
+            record.write(uint32_t(value.bytes().size()));
+            record.write_bytes(value.bytes().data(), value.bytes().size());
+            for (uint64_t a : actions)
+                record.write(a);
+            written[node] = flush();
+            header.nodes++;
+        }
+        header.root = written.at(&root);
+
+        BinaryWriter head;
+        head.write_bytes(snapshot::magic, sizeof(snapshot::magic));
+        head.write(snapshot::version);
+        head.write(snapshot::byte_order);
+        head.write(header.nodes);
+        head.write(header.actions);
+        head.write(header.rollout_depth);
+        head.write(header.gamma);
+        head.write(header.root);
+        out.seekp(0);
+        out.write(head.bytes().data(), head.bytes().size());
+        out.seekp(0, std::ios::end);
+        if (!out)
+            throw std::runtime_error("mcts: could not write the tree snapshot");
+    }
+
+    template <typename Node>
+    void save_tree(const Node& root, const std::string& path)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("mcts: could not open " + path);
+        save_tree(root, out);
+    }
+
+    /// Read-only view of a saved tree, mapped in memory when the platform has mmap
+    /// - opening only checks the header: the views decode nodes and actions when visited
+    /// - materialize() builds a searchable tree from any node of the snapshot, copying its whole subtree up front
+    /// - offsets that do not point backwards (see save_tree) throw std::runtime_error, so corrupted snapshots cannot loop
+    /// (views must not outlive their snapshot)
+    template <typename Node>
+    class TreeSnapshot {
+    public:
+        using node_ptr = std::shared_ptr<Node>;
+        using state_type = typename Node::state_type;
+        using action_type = snapshot::action_t<Node>;
+
+        class NodeView;
+
+        class ActionView {
+        public:
+            action_type action() const
+            {
+                BinaryReader in = _reader(_header_size);
+                return serializer<action_type>::read(in);
+            }
+
+            double value() const
+            {
+                return _field<double>(0);
+            }
+
+            double squared_value() const
+            {
+                return _field<double>(8);
+            }
+
+            size_t visits() const
+            {
+                return _field<uint64_t>(16);
+            }
+
+            /// number of outcome nodes
+            size_t size() const
+            {
+                return _field<uint32_t>(24);
+            }
+
+            NodeView child(size_t i) const
+            {
+                return NodeView(_snapshot, _snapshot->_below(_offset, _field<uint64_t>(_header_size + _field<uint32_t>(28) + 8 * i)));
+            }
+
+            /// the outcome node with `state` (valid() is false if there is none)
+            NodeView find(const state_type& state) const
+            {
+                for (size_t i = 0; i < size(); i++) {
+                    NodeView node = child(i);
+                    if (node.state() == state)
+                        return node;
+                }
+                return NodeView();
+            }
+
+        protected:
+            friend class NodeView;
+            friend class TreeSnapshot;
+            static constexpr size_t _header_size = 32;
+
+            const TreeSnapshot* _snapshot;
+            uint64_t _offset;
+
+            ActionView(const TreeSnapshot* snapshot, uint64_t offset) : _snapshot(snapshot), _offset(offset) {}
+
+            BinaryReader _reader(size_t at) const
+            {
+                return _snapshot->_reader(_offset + at);
+            }
+
+            template <typename T>
+            T _field(size_t at) const
+            {
+                return _reader(at).template read<T>();
+            }
+        };
+
+        class NodeView {
+        public:
+            NodeView() : _snapshot(nullptr), _offset(0) {}
+
+            bool valid() const
+            {
+                return _snapshot != nullptr;
+            }
+
+            state_type state() const
+            {
+                BinaryReader in = _reader(_header_size);
+                return serializer<state_type>::read(in);
+            }
+
+            size_t visits() const
+            {
+                return _field<uint64_t>(0);
+            }
+
+            size_t depth() const
+            {
+                return _field<uint64_t>(8);
+            }
+
+            /// number of actions
+            size_t size() const
+            {
+                return _field<uint32_t>(16);
+            }
+
+            ActionView action(size_t i) const
+            {
+                return ActionView(_snapshot, _snapshot->_below(_offset, _field<uint64_t>(_header_size + _field<uint32_t>(20) + 8 * i)));
+            }
+
+            /// the action `action` of this node (`first` is false if there is none)
+            std::pair<bool, ActionView> find(const action_type& action) const
+            {
+                for (size_t i = 0; i < size(); i++) {
+                    ActionView a = this->action(i);
+                    if (a.action() == action)
+                        return std::make_pair(true, a);
+                }
+                return std::make_pair(false, ActionView(_snapshot, 0));
+            }
+
+            uint64_t offset() const
+            {
+                return _offset;
+            }
+
+        protected:
+            friend class ActionView;
+            friend class TreeSnapshot;
+            static constexpr size_t _header_size = 24;
+
+            const TreeSnapshot* _snapshot;
+            uint64_t _offset;
+
+            NodeView(const TreeSnapshot* snapshot, uint64_t offset) : _snapshot(snapshot), _offset(offset) {}
+
+            BinaryReader _reader(size_t at) const
+            {
+                return _snapshot->_reader(_offset + at);
+            }
+
+            template <typename T>
+            T _field(size_t at) const
+            {
+                return _reader(at).template read<T>();
+            }
+        };
+
+        /// map the snapshot saved in `path` (throws std::runtime_error if it cannot be read or is not a snapshot)
+        explicit TreeSnapshot(const std::string& path) : _data(nullptr), _size(0), _mapped(false)
+        {
+#ifdef MCTS_HAS_MMAP
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("mcts: could not open " + path);
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    _data = static_cast<const char*>(p);
+                    _size = size_t(st.st_size);
+                    _mapped = true;
+                }
+            }
+            ::close(fd);
+            if (!_mapped)
+                throw std::runtime_error("mcts: could not map " + path);
+#else
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                throw std::runtime_error("mcts: could not open " + path);
+            _load(in);
+#endif
+            _read_header();
+        }
+
+        /// read a whole snapshot from a stream
+        explicit TreeSnapshot(std::istream& in) : _data(nullptr), _size(0), _mapped(false)
+        {
+            _load(in);
+            _read_header();
+        }
+
+        TreeSnapshot(const TreeSnapshot&) = delete;
+        TreeSnapshot& operator=(const TreeSnapshot&) = delete;
+
+        ~TreeSnapshot()
+        {
+#ifdef MCTS_HAS_MMAP
+            if (_mapped)
+                ::munmap(const_cast<char*>(_data), _size);
+#endif
+        }
+
+        NodeView root() const
+        {
+            return NodeView(this, _header.root);
+        }
+
+        size_t nodes() const
+        {
+            return _header.nodes;
+        }
+
+        size_t actions() const
+        {
+            return _header.actions;
+        }
+
+        size_t rollout_depth() const
+        {
+            return _header.rollout_depth;
+        }
+
+        double gamma() const
+        {
+            return _header.gamma;
+        }
+
+        /// a new tree holding the subtree below `view` (e.g. the node reached by the moves played so far)
+        /// (with a transposition table, its nodes are recorded in the table of the new tree)
+        /// the whole subtree is copied at once, or only down to `max_depth` moves below `view` (the nodes at that
+        /// depth keep their visits and are expanded again by later searches)
+        /// a node reached along several paths is created once if Node shares nodes (see shares_nodes); other node
+        /// types expect a single owner per node and throw std::runtime_error on such a snapshot
+        node_ptr materialize(const NodeView& view, size_t max_depth = std::numeric_limits<size_t>::max()) const
+        {
+            node_ptr root = std::make_shared<Node>(view.state(), rollout_depth(), gamma());
+            root->visits() = view.visits();
+
+            // every record is loaded once: a file can not make us create more nodes than it holds
+            std::unordered_map<uint64_t, node_ptr> created;
+            created[view.offset()] = root;
+            std::vector<std::tuple<Node*, NodeView, size_t>> stack(1, std::make_tuple(root.get(), view, size_t(0)));
+            while (!stack.empty()) {
+                Node* node = std::get<0>(stack.back());
+                NodeView theirs = std::get<1>(stack.back());
+                size_t depth = std::get<2>(stack.back());
+                stack.pop_back();
+                if (depth >= max_depth)
+                    continue;
+
+                for (size_t i = 0; i < theirs.size(); i++) {
+                    ActionView a = theirs.action(i);
+                    auto action = node->add_action(a.action());
+                    action->update_stats(a.value(), a.squared_value(), a.visits());
+
+                    for (size_t j = 0; j < a.size(); j++) {
+                        NodeView c = a.child(j);
+                        auto it = created.find(c.offset());
+                        if (it != created.end()) {
+                            if (!Node::shared_nodes)
+                                throw std::runtime_error("mcts: tree snapshot with shared nodes loaded into a node type that does not share them");
+                            action->attach_child(it->second);
+                            continue;
+                        }
+                        if (created.size() >= _header.nodes)
+                            throw std::runtime_error("mcts: corrupted tree snapshot");
+                        node_ptr child = action->add_child(c.state());
+                        child->visits() = c.visits();
+                        created[c.offset()] = child;
+                        stack.emplace_back(child.get(), c, depth + 1);
+                    }
+                }
+            }
+
+            // later searches find the loaded nodes again from other paths
+            root->record_nodes();
+            return root;
+        }
+
+        node_ptr materialize() const
+        {
+            return materialize(root());
+        }
+
+    protected:
+        const char* _data;
+        size_t _size;
+        bool _mapped;
+        std::string _buffer;
+        snapshot::Header _header;
+
+        void _load(std::istream& in)
+        {
+            _buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            _data = _buffer.data();
+            _size = _buffer.size();
+        }
+
+        void _read_header()
+        {
+            BinaryReader in = _reader(0);
+            char magic[sizeof(snapshot::magic)];
+            in.read_bytes(magic, sizeof(magic));
+            if (std::memcmp(magic, snapshot::magic, sizeof(magic)) != 0)
+                throw std::runtime_error("mcts: not a tree snapshot");
+            if (in.template read<uint32_t>() != snapshot::version)
+                throw std::runtime_error("mcts: unsupported tree snapshot version");
+            if (in.template read<uint32_t>() != snapshot::byte_order)
+                throw std::runtime_error("mcts: tree snapshot saved with another byte order");
+            _header.nodes = in.template read<uint64_t>();
+            _header.actions = in.template read<uint64_t>();
+            _header.rollout_depth = in.template read<uint64_t>();
+            _header.gamma = in.template read<double>();
+            _header.root = in.template read<uint64_t>();
+        }
+
+        BinaryReader _reader(uint64_t offset) const
+        {
+            if (offset > _size)
+                throw std::runtime_error("mcts: corrupted tree snapshot");
+            return BinaryReader(_data + offset, _data + _size);
+        }
+
+        // the offset of a record below the one at `parent` (records are written children first)
+        uint64_t _below(uint64_t parent, uint64_t child) const
+        {
+            if (child >= parent || child < snapshot::header_size)
+                throw std::runtime_error("mcts: corrupted tree snapshot");
+            return child;
+        }
+    };
+
+    /// read a tree saved with save_tree()
+    template <typename Node>
+    std::shared_ptr<Node> load_tree(std::istream& in)
+    {
+        return TreeSnapshot<Node>(in).materialize();
+    }
+
+    template <typename Node>
+    std::shared_ptr<Node> load_tree(const std::string& path)
+    {
+        return TreeSnapshot<Node>(path).materialize();
+    }
+} // namespace mcts
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef MCTS_STATS_HPP
+#define MCTS_STATS_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <mcts/parallel.hpp>
+
+namespace mcts {
+
+    /// plain copy of the statistics of a search (see MCTSNode::stats())
+    struct StatsReport {
+        size_t iterations = 0;
+        size_t nodes_created = 0, actions_created = 0;
+        /// created nodes per depth, the last bucket also counts the deeper ones
+        std::vector<size_t> depth_histogram;
+        size_t max_depth = 0;
+        /// time per phase; expansion is the descent step that adds the leaf node, selection the other steps
+        double selection_seconds = 0.0, expansion_seconds = 0.0, rollout_seconds = 0.0, backup_seconds = 0.0;
+        size_t rollouts = 0, rollout_steps = 0, max_rollout_length = 0;
+        /// number of actions of the nodes the selection went through
+        size_t branching_samples = 0, branching_total = 0, max_branching = 0;
+        /// iterations run by each thread
+        std::vector<size_t> thread_iterations;
+
+        double mean_rollout_length() const
+        {
+            return rollouts ? double(rollout_steps) / double(rollouts) : 0.0;
+        }
+
+        double mean_branching() const
+        {
+            return branching_samples ? double(branching_total) / double(branching_samples) : 0.0;
+        }
+
+        void write_text(std::ostream& out) const
+        {
+            out << "iterations: " << iterations << "\n"
+                << "nodes created: " << nodes_created << ", actions created: " << actions_created << "\n"
+                << "max depth: " << max_depth << "\n"
+                << "time (s): selection " << selection_seconds << ", expansion " << expansion_seconds << ", rollout " << rollout_seconds << ", backup " << backup_seconds << "\n"
+                << "rollouts: " << rollouts << ", mean length " << mean_rollout_length() << ", max length " << max_rollout_length << "\n"
+                << "branching: mean " << mean_branching() << ", max " << max_branching << "\n"
+                << "depth histogram:";
+            for (size_t d = 0; d < depth_histogram.size(); d++) {
+                if (depth_histogram[d])
+                    out << " " << d << ":" << depth_histogram[d];
+            }
+            out << "\nthread iterations:";
+            for (size_t n : thread_iterations)
+                out << " " << n;
+            out << "\n";
+        }
+
+        void write_json(std::ostream& out) const
+        {
+            out << "{\"iterations\": " << iterations
+                << ", \"nodes_created\": " << nodes_created
+                << ", \"actions_created\": " << actions_created
+                << ", \"max_depth\": " << max_depth
+                << ", \"selection_seconds\": " << selection_seconds
+                << ", \"expansion_seconds\": " << expansion_seconds
+                << ", \"rollout_seconds\": " << rollout_seconds
+                << ", \"backup_seconds\": " << backup_seconds
+                << ", \"rollouts\": " << rollouts
+                << ", \"mean_rollout_length\": " << mean_rollout_length()
+                << ", \"max_rollout_length\": " << max_rollout_length
+                << ", \"mean_branching\": " << mean_branching()
+                << ", \"max_branching\": " << max_branching
+                << ", \"depth_histogram\": ";
+            _write_array(out, depth_histogram);
+            out << ", \"thread_iterations\": ";
+            _write_array(out, thread_iterations);
+            out << "}";
+        }
+
+    protected:
+        static void _write_array(std::ostream& out, const std::vector<size_t>& values)
+        {
+            out << "[";
+            for (size_t i = 0; i < values.size(); i++)
+                out << (i ? ", " : "") << values[i];
+            out << "]";
+        }
+    };
+
+    /// Tree-wide search statistics, updated through StatsRecorder<true> only
+    /// (every tree has one, it stays untouched unless Params::mcts_node::stats() is true)
+    class SearchStats {
+    public:
+        static constexpr size_t depth_buckets = 64;
+
+        SearchStats()
+        {
+            for (auto& bucket : _depths)
+                bucket = 0;
+        }
+
+        void add_node(size_t depth)
+        {
+            _nodes.fetch_add(1);
+            _depths[std::min(depth, depth_buckets - 1)].fetch_add(1);
+            _update_max(_max_depth, depth);
+        }
+
+        void add_action()
+        {
+            _actions.fetch_add(1);
+        }
+
+        void add_iteration(uint64_t selection_ns, uint64_t expansion_ns, uint64_t rollout_ns, uint64_t backup_ns)
+        {
+            _iterations.fetch_add(1);
+            _selection_ns.fetch_add(selection_ns);
+            _expansion_ns.fetch_add(expansion_ns);
+            _rollout_ns.fetch_add(rollout_ns);
+            _backup_ns.fetch_add(backup_ns);
+        }
+
+        void add_rollout(size_t length)
+        {
+            _rollouts.fetch_add(1);
+            _rollout_steps.fetch_add(length);
+            _update_max(_max_rollout, length);
+        }
+
+        void add_branching(size_t actions)
+        {
+            _branching_samples.fetch_add(1);
+            _branching_total.fetch_add(actions);
+            _update_max(_max_branching, actions);
+        }
+
+        /// `iterations` more iterations run by the calling thread
+        void add_thread_iterations(size_t iterations)
+        {
+            _add_thread_iterations(std::this_thread::get_id(), iterations);
+        }
+
+        /// add the statistics of another tree, e.g. a root-parallel worker (its depths count from its own root)
+        void merge_search(const SearchStats& other)
+        {
+            _iterations.fetch_add(other._iterations);
+            _nodes.fetch_add(other._nodes);
+            _actions.fetch_add(other._actions);
+            for (size_t d = 0; d < depth_buckets; d++)
+                _depths[d].fetch_add(other._depths[d]);
+            _update_max(_max_depth, other._max_depth);
+            _selection_ns.fetch_add(other._selection_ns);
+            _expansion_ns.fetch_add(other._expansion_ns);
+            _rollout_ns.fetch_add(other._rollout_ns);
+            _backup_ns.fetch_add(other._backup_ns);
+            _rollouts.fetch_add(other._rollouts);
+            _rollout_steps.fetch_add(other._rollout_steps);
+            _update_max(_max_rollout, other._max_rollout);
+            _branching_samples.fetch_add(other._branching_samples);
+            _branching_total.fetch_add(other._branching_total);
+            _update_max(_max_branching, other._max_branching);
+
+            std::vector<std::pair<std::thread::id, size_t>> threads;
+            {
+                std::lock_guard<par::spin_lock> lock(const_cast<par::spin_lock&>(other._lock));
+                threads = other._threads;
+            }
+            for (const auto& t : threads)
+                _add_thread_iterations(t.first, t.second);
+        }
+
+        /// the node and action counts, e.g. to leave out the copies a merge makes (see restore_counts())
+        struct Counts {
+            size_t nodes, actions, max_depth;
+            std::array<size_t, depth_buckets> depths;
+        };
+
+        Counts counts() const
+        {
+            Counts c;
+            c.nodes = _nodes;
+            c.actions = _actions;
+            c.max_depth = _max_depth;
+            for (size_t d = 0; d < depth_buckets; d++)
+                c.depths[d] = _depths[d];
+            return c;
+        }
+
+        void restore_counts(const Counts& c)
+        {
+            _nodes = c.nodes;
+            _actions = c.actions;
+            _max_depth = c.max_depth;
+            for (size_t d = 0; d < depth_buckets; d++)
+                _depths[d] = c.depths[d];
+        }
+
+        StatsReport report() const
+        {
+            StatsReport r;
+            r.iterations = _iterations;
+            r.nodes_created = _nodes;
+            r.actions_created = _actions;
+            r.max_depth = _max_depth;
+            for (const auto& bucket : _depths)
+                r.depth_histogram.push_back(bucket);
+            while (!r.depth_histogram.empty() && r.depth_histogram.back() == 0)
+                r.depth_histogram.pop_back();
+            r.selection_seconds = _selection_ns * 1e-9;
+            r.expansion_seconds = _expansion_ns * 1e-9;
+            r.rollout_seconds = _rollout_ns * 1e-9;
+            r.backup_seconds = _backup_ns * 1e-9;
+            r.rollouts = _rollouts;
+            r.rollout_steps = _rollout_steps;
+            r.max_rollout_length = _max_rollout;
+            r.branching_samples = _branching_samples;
+            r.branching_total = _branching_total;
+            r.max_branching = _max_branching;
+
+            std::lock_guard<par::spin_lock> lock(_lock);
+            for (const auto& t : _threads)
+                r.thread_iterations.push_back(t.second);
+            return r;
+        }
+
+    protected:
+        par::relaxed_atomic<size_t> _iterations, _nodes, _actions, _max_depth;
+        std::array<par::relaxed_atomic<size_t>, depth_buckets> _depths;
+        par::relaxed_atomic<uint64_t> _selection_ns, _expansion_ns, _rollout_ns, _backup_ns;
+        par::relaxed_atomic<size_t> _rollouts, _rollout_steps, _max_rollout;
+        par::relaxed_atomic<size_t> _branching_samples, _branching_total, _max_branching;
+        std::vector<std::pair<std::thread::id, size_t>> _threads;
+        mutable par::spin_lock _lock;
+
+        static void _update_max(par::relaxed_atomic<size_t>& max, size_t value)
+        {
+            // statistics only: a lost race may keep a slightly smaller maximum
+            if (value > max)
+                max = value;
+        }
+
+        void _add_thread_iterations(std::thread::id id, size_t iterations)
+        {
+            std::lock_guard<par::spin_lock> lock(_lock);
+            for (auto& t : _threads) {
+                if (t.first == id) {
+                    t.second += iterations;
+                    return;
+                }
+            }
+            _threads.emplace_back(id, iterations);
+        }
+    };
+
+    /// Records into SearchStats when Enabled, compiles to nothing otherwise
+    template <bool Enabled>
+    struct StatsRecorder {
+        /// nanoseconds since the previous lap
+        class stopwatch {
+        public:
+            uint64_t lap() { return 0; }
+        };
+
+        static void node(SearchStats&, size_t) {}
+        static void action(SearchStats&) {}
+        static void iteration(SearchStats&, uint64_t, uint64_t, uint64_t, uint64_t) {}
+        static void rollout(SearchStats&, size_t) {}
+        static void branching(SearchStats&, size_t) {}
+        static void thread_iterations(SearchStats&, size_t) {}
+        static void merge(SearchStats&, const SearchStats&) {}
+
+        template <typename F>
+        static void uncounted(SearchStats&, F f)
+        {
+            f();
+        }
+    };
+
+    template <>
+    struct StatsRecorder<true> {
+        class stopwatch {
+        public:
+            stopwatch() : _last(std::chrono::steady_clock::now()) {}
+
+            uint64_t lap()
+            {
+                auto now = std::chrono::steady_clock::now();
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count();
+                _last = now;
+                return ns;
+            }
+
+        protected:
+            std::chrono::steady_clock::time_point _last;
+        };
+
+        static void node(SearchStats& stats, size_t depth)
+        {
+            stats.add_node(depth);
+        }
+
+        static void action(SearchStats& stats)
+        {
+            stats.add_action();
+        }
+
+        static void iteration(SearchStats& stats, uint64_t selection_ns, uint64_t expansion_ns, uint64_t rollout_ns, uint64_t backup_ns)
+        {
+            stats.add_iteration(selection_ns, expansion_ns, rollout_ns, backup_ns);
+        }
+
+        static void rollout(SearchStats& stats, size_t length)
+        {
+            stats.add_rollout(length);
+        }
+
+        static void branching(SearchStats& stats, size_t actions)
+        {
+            stats.add_branching(actions);
+        }
+
+        static void thread_iterations(SearchStats& stats, size_t iterations)
+        {
+            stats.add_thread_iterations(iterations);
+        }
+
+        static void merge(SearchStats& stats, const SearchStats& other)
+        {
+            stats.merge_search(other);
+        }
+
+        /// runs f without counting the nodes and actions it creates (nothing else may create any meanwhile)
+        template <typename F>
+        static void uncounted(SearchStats& stats, F f)
+        {
+            SearchStats::Counts counts = stats.counts();
+            f();
+            stats.restore_counts(counts);
+        }
+    };
+} // namespace mcts
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef MCTS_TRAITS_HPP
+#define MCTS_TRAITS_HPP
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace mcts {
+
+    template <typename...>
+    struct make_void {
+        using type = void;
+    };
+
+    template <typename... Ts>
+    using void_t = typename make_void<Ts...>::type;
+
+    /// reward functor of the form: double operator()(const State& from, const Action& action, const State& to)
+    template <typename RewardFunc, typename State, typename Action, typename = void>
+    struct has_value_reward : std::false_type {
+    };
+
+    template <typename RewardFunc, typename State, typename Action>
+    struct has_value_reward<RewardFunc, State, Action, void_t<decltype(std::declval<RewardFunc&>()(std::declval<const State&>(), std::declval<const Action&>(), std::declval<const State&>()))>> : std::true_type {
+    };
+
+    /// default policy of the form: Action operator()(const State& state)
+    template <typename Policy, typename State, typename = void>
+    struct has_value_policy : std::false_type {
+    };
+
+    template <typename Policy, typename State>
+    struct has_value_policy<Policy, State, void_t<decltype(std::declval<Policy&>()(std::declval<const State&>()))>> : std::true_type {
+    };
+
+    /// state transition writing into an existing state: void move_into(const Action& action, State& out) const
+    template <typename State, typename Action, typename = void>
+    struct has_move_into : std::false_type {
+    };
+
+    template <typename State, typename Action>
+    struct has_move_into<State, Action, void_t<decltype(std::declval<const State&>().move_into(std::declval<const Action&>(), std::declval<State&>()))>> : std::true_type {
+    };
+
+    /// batched state transitions, stepping several states at once (e.g. with SIMD):
+    ///   static void move_batch(const State* const* from, const Action* actions, State* const* to, size_t n)
+    ///   static void terminal_batch(const State* const* states, bool* terminal, size_t n)
+    /// move_batch writes the successor of from[i] into the existing state *to[i] (like move_into)
+    template <typename State, typename Action, typename = void>
+    struct has_batch_moves : std::false_type {
+    };
+
+    template <typename State, typename Action>
+    struct has_batch_moves<State, Action, void_t<decltype(State::move_batch(std::declval<const State* const*>(), std::declval<const Action*>(), std::declval<State* const*>(), std::declval<size_t>())), decltype(State::terminal_batch(std::declval<const State* const*>(), std::declval<bool*>(), std::declval<size_t>()))>> : std::true_type {
+    };
+
+    /// batched reward functor: void operator()(const State* const* from, const Action* actions, const State* const* to, double* rewards, size_t n)
+    template <typename RewardFunc, typename State, typename Action, typename = void>
+    struct has_batch_reward : std::false_type {
+    };
+
+    template <typename RewardFunc, typename State, typename Action>
+    struct has_batch_reward<RewardFunc, State, Action, void_t<decltype(std::declval<RewardFunc&>()(std::declval<const State* const*>(), std::declval<const Action*>(), std::declval<const State* const*>(), std::declval<double*>(), std::declval<size_t>()))>> : std::true_type {
+    };
+
+    /// batched default policy: void operator()(const State* const* states, Action* actions, size_t n)
+    template <typename Policy, typename State, typename Action, typename = void>
+    struct has_batch_policy : std::false_type {
+    };
+
+    template <typename Policy, typename State, typename Action>
+    struct has_batch_policy<Policy, State, Action, void_t<decltype(std::declval<Policy&>()(std::declval<const State* const*>(), std::declval<Action*>(), std::declval<size_t>()))>> : std::true_type {
+    };
+
+    /// batched action value, scoring all the children of a node at once from structure-of-arrays inputs:
+    /// void operator()(double parent_visits, const double* values, const double* visits, double* scores, size_t n)
+    template <typename Value, typename = void>
+    struct has_batch_value : std::false_type {
+    };
+
+    template <typename Value>
+    struct has_batch_value<Value, void_t<decltype(std::declval<Value&>()(std::declval<double>(), std::declval<const double*>(), std::declval<const double*>(), std::declval<double*>(), std::declval<size_t>()))>> : std::true_type {
+    };
+
+    /// outcome selection that can attach the same node below several actions (e.g. a transposition table):
+    /// static constexpr bool shares_nodes = true;
+    template <typename OutcomeSelection, typename = void>
+    struct shares_nodes : std::false_type {
+    };
+
+    template <typename OutcomeSelection>
+    struct shares_nodes<OutcomeSelection, void_t<decltype(OutcomeSelection::shares_nodes)>> : std::integral_constant<bool, OutcomeSelection::shares_nodes> {
+    };
+
+    /// outcome selection keeping its own record of the nodes of a tree (e.g. a transposition table),
+    /// told about the nodes of copied or loaded trees: static void record(const std::shared_ptr<Node>& node)
+    template <typename OutcomeSelection, typename Node, typename = void>
+    struct has_record_node : std::false_type {
+    };
+
+    template <typename OutcomeSelection, typename Node>
+    struct has_record_node<OutcomeSelection, Node, void_t<decltype(OutcomeSelection::record(std::declval<const std::shared_ptr<Node>&>()))>> : std::true_type {
+    };
+
+    /// search statistics, off unless Params::mcts_node has a compile-time flag: MCTS_PARAM(bool, stats, true)
+    template <typename Params, typename = void>
+    struct stats_enabled : std::false_type {
+    };
+
+    template <typename Params>
+    struct stats_enabled<Params, void_t<std::integral_constant<bool, Params::mcts_node::stats()>>> : std::integral_constant<bool, Params::mcts_node::stats()> {
+    };
+} // namespace mcts
+
+#endif
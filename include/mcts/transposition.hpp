@@ -0,0 +1,118 @@
+#ifndef MCTS_TRANSPOSITION_HPP
+#define MCTS_TRANSPOSITION_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include <mcts/index.hpp>
+#include <mcts/memory.hpp>
+#include <mcts/parallel.hpp>
+
+namespace mcts {
+
+    /// Bounded table of the nodes of a tree, keyed by (state, depth)
+    /// - keying by depth keeps the search graph acyclic (a DAG)
+    /// - two-way buckets: when both entries are taken, the less visited node is evicted
+    /// - striped locks: safe when several threads grow the same tree
+    /// - does not own the nodes (weak references with reference-counted storage)
+    /// States are hashed with child_hash<State> (see index.hpp)
+    template <typename Node, bool Weak = Node::storage_type::reference_counted>
+    class TranspositionTable {
+    public:
+        using node_ptr = std::shared_ptr<Node>;
+        using state_type = typename Node::state_type;
+
+        static_assert(has_child_hash<state_type>::value, "TranspositionTable: specialize mcts::child_hash<State>");
+
+        explicit TranspositionTable(size_t size) : _buckets(std::max(size / _ways, size_t(1))) {}
+
+        /// the node of `state` at `depth`, or the one made by `create()` (which is then recorded)
+        template <typename Create>
+        node_ptr find_or_insert(const state_type& state, size_t depth, Create create)
+        {
+            size_t hash = _hash(state, depth);
+            size_t b = hash % _buckets.size();
+            Bucket& bucket = _buckets[b];
+            // the stripe follows the bucket: the bucket count is not a multiple of the stripe count
+            std::lock_guard<par::spin_lock> lock(_locks[b % _stripes]);
+
+            Entry* victim = nullptr;
+            size_t victim_visits = 0;
+            for (Entry& entry : bucket) {
+                node_ptr node = _load(entry.node);
+                if (!node) {
+                    victim = &entry;
+                    victim_visits = 0;
+                    continue;
+                }
+                if (entry.hash == hash && node->depth() == depth && *(node->state()) == state)
+                    return node;
+                if (victim == nullptr || node->visits() < victim_visits) {
+                    victim = &entry;
+                    victim_visits = node->visits();
+                }
+            }
+
+            node_ptr node = create();
+            victim->hash = hash;
+            _store(victim->node, node);
+            return node;
+        }
+
+        size_t capacity() const
+        {
+            return _buckets.size() * _ways;
+        }
+
+    protected:
+        using handle_type = typename std::conditional<Weak, std::weak_ptr<Node>, Node*>::type;
+
+        struct Entry {
+            Entry() : hash(0), node() {}
+
+            size_t hash;
+            handle_type node;
+        };
+
+        static constexpr size_t _ways = 2;
+        static constexpr size_t _stripes = 64;
+
+        using Bucket = std::array<Entry, _ways>;
+
+        std::vector<Bucket> _buckets;
+        std::array<par::spin_lock, _stripes> _locks;
+
+        static size_t _hash(const state_type& state, size_t depth)
+        {
+            size_t h = child_hash<state_type>::hash(state);
+            return h ^ (depth + size_t(0x9e3779b97f4a7c15ULL) + (h << 6) + (h >> 2));
+        }
+
+        static node_ptr _load(const std::weak_ptr<Node>& handle)
+        {
+            return handle.lock();
+        }
+
+        static node_ptr _load(Node* handle)
+        {
+            return handle ? make_ref(handle) : nullptr;
+        }
+
+        static void _store(std::weak_ptr<Node>& handle, const node_ptr& node)
+        {
+            handle = node;
+        }
+
+        static void _store(Node*& handle, const node_ptr& node)
+        {
+            handle = node.get();
+        }
+    };
+} // namespace mcts
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef MCTS_TUNING_HPP
+#define MCTS_TUNING_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mcts/random.hpp>
+#include <mcts/serialize.hpp>
+
+namespace mcts {
+
+    /// a search parameter explored by tune(): values in [min, max], drawn uniformly or on a log scale
+    /// `set` writes it before a trial, e.g. Params::uct::set_c (see MCTS_DYN_PARAM); it is a plain function,
+    /// which trials running in another process can call as well
+    struct TunedParam {
+        std::string name;
+        double min, max;
+        bool log_scale;
+        bool integer;
+        void (*set)(const double&);
+    };
+
+    namespace detail {
+        // job of tune(): the trials of one worker in a round
+        // request: trial, setters, then the seed and the values of every trial; result: quality and ms of every trial
+        template <typename Trial>
+        struct TuneTrials {
+            static std::string run(const std::string& request)
+            {
+                BinaryReader in(request.data(), request.data() + request.size());
+                ObjectCopy<Trial> trial(in);
+                std::vector<void (*)(const double&)> setters(in.read<uint32_t>());
+                for (auto& set : setters)
+                    set = in.read<void (*)(const double&)>();
+
+                BinaryWriter out;
+                for (uint32_t n = in.read<uint32_t>(); n > 0; n--) {
+                    uint64_t seed = in.read<uint64_t>();
+                    for (auto set : setters)
+                        set(in.read<double>());
+                    rng::seed(seed);
+
+                    auto start = std::chrono::steady_clock::now();
+                    double quality = trial.get()();
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    out.write(quality);
+                    out.write(ms);
+                }
+                return out.bytes();
+            }
+        };
+    } // namespace detail
+
+    struct TuneOptions {
+        /// each round draws its candidates around the best configuration so far, in ranges shrunk by `shrink`
+        size_t rounds = 4;
+        size_t candidates = 16;
+        double shrink = 0.5;
+        /// trials per candidate, with the same seeds for all candidates (common random numbers)
+        size_t repeats = 4;
+        /// trials running at once (0: one per hardware thread)
+        size_t workers = 0;
+        uint64_t seed = 1;
+    };
+
+    /// a configuration evaluated by tune(), averaged over its trials
+    struct TuneResult {
+        std::vector<double> values;
+        double quality = 0.0, ms = 0.0;
+
+        /// decision quality per millisecond of search
+        double score() const
+        {
+            return quality / std::max(ms, 1e-3);
+        }
+    };
+
+    /// Search the parameters `params` for the best decision quality per millisecond on a domain
+    /// - `trial()` runs one search with the parameters already set and the random stream seeded,
+    ///   and returns the quality of its decision (higher is better, e.g. 1 if the best action is right)
+    /// - the trials run through `transport` (see distributed.hpp) on `options.workers` workers, each running
+    ///   its share of a round in turn (a single request per worker and round, not per trial);
+    ///   parameters are process-wide statics, so they need separate processes (ForkTransport),
+    ///   and each trial should search sequentially (e.g. parallel_roots = 1)
+    /// - `trial` travels to the workers as a copy of its bytes (see write_object(): capture by value)
+    /// Returns every configuration evaluated, best score first.
+    template <typename Transport, typename Trial>
+    std::vector<TuneResult> tune(const std::vector<TunedParam>& params, Trial trial, Transport& transport, const TuneOptions& options = TuneOptions())
+    {
+        const size_t workers = (options.workers > 0) ? options.workers : std::max(1u, std::thread::hardware_concurrency());
+        rng::Xoshiro256 generator(options.seed);
+
+        // the search happens in the transformed space (log for log_scale parameters)
+        auto to_space = [&](size_t p, double v) { return params[p].log_scale ? std::log(v) : v; };
+        auto from_space = [&](size_t p, double x) {
+            double v = params[p].log_scale ? std::exp(x) : x;
+            v = std::min(std::max(v, params[p].min), params[p].max);
+            return params[p].integer ? std::round(v) : v;
+        };
+
+        std::vector<TuneResult> results;
+        std::vector<double> center(params.size()), width(params.size());
+        for (size_t p = 0; p < params.size(); p++) {
+            double lo = to_space(p, params[p].min), hi = to_space(p, params[p].max);
+            center[p] = 0.5 * (lo + hi);
+            width[p] = hi - lo;
+        }
+
+        for (size_t round = 0; round < options.rounds; round++) {
+            std::vector<TuneResult> candidates(options.candidates);
+            for (TuneResult& c : candidates) {
+                for (size_t p = 0; p < params.size(); p++)
+                    c.values.push_back(from_space(p, center[p] + (generator.uniform() - 0.5) * width[p]));
+            }
+
+            // one job per (candidate, repeat); worker w runs the jobs w, w + workers, ...
+            // (a single request per worker and round)
+            size_t jobs = candidates.size() * options.repeats;
+            size_t n = std::min(workers, jobs);
+            std::vector<std::string> requests;
+            for (size_t worker = 0; worker < n; worker++) {
+                BinaryWriter out;
+                write_object(out, trial);
+                out.write(uint32_t(params.size()));
+                for (const TunedParam& p : params)
+                    out.write(p.set);
+                out.write(uint32_t((jobs - worker + n - 1) / n));
+                for (size_t job = worker; job < jobs; job += n) {
+                    out.write(uint64_t(options.seed + job % options.repeats));
+                    for (double v : candidates[job / options.repeats].values)
+                        out.write(v);
+                }
+                requests.push_back(out.bytes());
+            }
+            std::vector<std::string> bytes = transport.template run<detail::TuneTrials<Trial>>(requests);
+
+            for (size_t worker = 0; worker < n; worker++) {
+                BinaryReader in(bytes[worker].data(), bytes[worker].data() + bytes[worker].size());
+                for (size_t job = worker; job < jobs; job += n) {
+                    TuneResult& c = candidates[job / options.repeats];
+                    c.quality += in.read<double>() / options.repeats;
+                    c.ms += in.read<double>() / options.repeats;
+                }
+            }
+
+            results.insert(results.end(), candidates.begin(), candidates.end());
+            std::sort(results.begin(), results.end(), [](const TuneResult& a, const TuneResult& b) { return a.score() > b.score(); });
+
+            // the next round zooms in on the best configuration
+            for (size_t p = 0; p < params.size(); p++) {
+                center[p] = to_space(p, results.front().values[p]);
+                width[p] *= options.shrink;
+            }
+        }
+
+        return results;
+    }
+} // namespace mcts
+
+#endif
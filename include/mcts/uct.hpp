@@ -3,36 +3,61 @@
 
 #include <algorithm>
 #include <cassert>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include <mcts/budget.hpp>
 #include <mcts/defaults.hpp>
+#include <mcts/index.hpp>
 #include <mcts/macros.hpp>
+#include <mcts/memory.hpp>
 #include <mcts/parallel.hpp>
+#include <mcts/random.hpp>
+#include <mcts/sampler.hpp>
+#include <mcts/stats.hpp>
+#include <mcts/traits.hpp>
+#include <mcts/visit.hpp>
 
 namespace mcts {
 
-    template <typename Params, typename NodeType, typename OutcomeSelection, typename ActionType = size_t>
-    class MCTSAction : public std::enable_shared_from_this<MCTSAction<Params, NodeType, OutcomeSelection, ActionType>> {
+    /// `Statistics` keeps the returns backed up through the action (see SumStatistics, MeanStatistics)
+    template <typename Params, typename NodeType, typename OutcomeSelection, typename ActionType = size_t, typename Storage = SharedStorage, typename Statistics = SumStatistics>
+    class MCTSAction {
     public:
-        using action_type = MCTSAction<Params, NodeType, OutcomeSelection, ActionType>;
+        using action_type = MCTSAction<Params, NodeType, OutcomeSelection, ActionType, Storage, Statistics>;
+        using statistics_type = Statistics;
         using node_ptr = std::shared_ptr<NodeType>;
+        using state_type = typename NodeType::state_type;
+        using children_type = typename Storage::template vector<node_ptr>;
 
-        MCTSAction(const ActionType& action, const node_ptr& parent, double value) : _parent(parent), _action(action), _value(value), _visits(0) {}
+        /// with arena storage, actions are only destroyed when they own memory outside of the arena
+        /// (their children and sampler vectors live in it, a hashed index of the outcomes does not)
+        static constexpr bool arena_finalize = has_child_hash<state_type>::value || !std::is_trivially_destructible<ActionType>::value;
 
-        node_ptr parent()
+        MCTSAction(const ActionType& action, const node_ptr& parent, double value) : _stats(value), _visits(0), _action(action), _parent(make_ref(parent.get())), _children(Storage::template make_vector<node_ptr>(parent->storage())), _sampler(Storage::template make_vector<size_t>(parent->storage())), _attached(false) {}
+
+        node_ptr parent() const
+        {
+            return _parent;
+        }
+
+        node_ptr& parent()
         {
             return _parent;
         }
 
-        std::vector<node_ptr> children() const
+        const children_type& children() const
         {
             return _children;
         }
 
-        std::vector<node_ptr>& children()
+        children_type& children()
         {
             return _children;
         }
@@ -47,19 +72,51 @@ namespace mcts {
             return _visits;
         }
 
-        size_t& visits()
+        /// sum of the returns (written through update_stats())
+        double value() const
+        {
+            return _stats.value(_visits);
+        }
+
+        /// sum of the squared returns
+        double squared_value() const
         {
-            return _visits;
+            return _stats.squared_value(_visits);
         }
 
-        double value() const
+        /// writable statistics of SumStatistics actions, kept for code that updated the sums by hand: deprecated,
+        /// update_stats() updates any statistics (writes through these warn, reads do not)
+        template <typename S = Statistics, typename std::enable_if<S::lock_free, int>::type = 0>
+        WritableStatistic<size_t> visits()
+        {
+            return WritableStatistic<size_t>(_visits);
+        }
+
+        template <typename S = Statistics, typename std::enable_if<S::lock_free, int>::type = 0>
+        WritableStatistic<double> value()
+        {
+            return WritableStatistic<double>(_stats.value());
+        }
+
+        template <typename S = Statistics, typename std::enable_if<S::lock_free, int>::type = 0>
+        WritableStatistic<double> squared_value()
+        {
+            return WritableStatistic<double>(_stats.squared_value());
+        }
+
+        double variance() const
         {
-            return _value;
+            size_t visits = _visits;
+            if (visits == 0)
+                return 0.0;
+            double mean = _stats.value(visits) / double(visits);
+            return std::max(0.0, _stats.squared_value(visits) / double(visits) - mean * mean);
         }
 
-        double& value()
+        /// guards the outcome children when the tree is searched by several threads
+        par::spin_lock& mutex()
         {
-            return _value;
+            return _lock;
         }
 
         bool operator==(const MCTSAction& other) const
@@ -69,40 +126,210 @@ namespace mcts {
 
         node_ptr node()
         {
-            return OutcomeSelection()(this->shared_from_this());
+            return OutcomeSelection()(make_ref(this));
+        }
+
+        /// the outcome node already reached with `state` (nullptr if none), hashed when child_hash<State> is specialized
+        node_ptr find_child(const state_type& state)
+        {
+            auto it = _index.find(_children, state, _state_of);
+            return (it == _children.end()) ? nullptr : *it;
+        }
+
+        /// create the outcome node for `state` in the tree's storage and attach it to this action
+        node_ptr add_child(const state_type& state)
+        {
+            // nodes holding a hash index have to be destroyed with the arena
+            node_ptr child = Storage::template make<NodeType, NodeType::arena_finalize>(_parent->storage(), state, _parent->storage(), _parent->depth() + 1);
+            child->parent() = make_ref(this);
+            child->slot() = _children.size();
+            _index.insert(state, _children.size());
+            _sampler.push_back();
+            _children.push_back(child);
+            return child;
+        }
+
+        /// transpositions: attach a node of this tree that was first reached through another action
+        /// (its parent() stays that first action)
+        void attach_child(const node_ptr& child)
+        {
+            _index.insert(*(child->state()), _children.size());
+            _children.push_back(child);
+            // its visits also come from the other paths: sample_child() goes back to counting them
+            _attached = true;
+            child->shared() = true;
+        }
+
+        /// detach an outcome node (the rest of the children keep their order)
+        void remove_child(typename children_type::iterator child)
+        {
+            _children.erase(child);
+            _children_moved();
+        }
+
+        /// detach the outcome nodes for which `pred(node)` is true, returns how many were detached
+        template <typename Pred>
+        size_t remove_children_if(Pred pred)
+        {
+            auto end = std::remove_if(_children.begin(), _children.end(), pred);
+            size_t removed = _children.end() - end;
+            if (removed > 0) {
+                _children.erase(end, _children.end());
+                _children_moved();
+            }
+            return removed;
+        }
+
+        /// a known outcome node, drawn in proportion to its visits (uniformly while none was visited)
+        /// - O(log n): the visits are mirrored in a Fenwick tree, built on the first call and then
+        ///   kept in sync by the backup (see child_visited())
+        /// - call invalidate_sampler() after writing the visits() of outcome nodes directly
+        node_ptr sample_child()
+        {
+            assert(!_children.empty());
+            if (!_sampler.valid() || _attached)
+                _sampler.rebuild(_children, [](const node_ptr& child) -> size_t { return child->visits(); });
+            if (_sampler.total() == 0)
+                return _children[rng::below(_children.size())];
+            return _children[_sampler.find(rng::below(_sampler.total()))];
+        }
+
+        /// `count` more visits for one of the outcome nodes, backed up through this action
+        void child_visited(const NodeType& child, size_t count)
+        {
+            // attached nodes have no slot here (the sampler is rebuilt anyway),
+            // and shared ones also get visits through other actions
+            if (_attached)
+                return;
+            if (child.shared())
+                _sampler.invalidate();
+            else
+                _sampler.add(child.slot(), count);
+        }
+
+        void invalidate_sampler()
+        {
+            _sampler.invalidate();
         }
 
         void update_stats(double value)
         {
-            _value += value;
-            _visits++;
+            update_stats(value, value * value, 1);
+        }
+
+        /// batched backup: `value` and `squared_value` are sums over `count` returns
+        /// (also adds merged or loaded statistics)
+        void update_stats(double value, double squared_value, size_t count)
+        {
+            _stats.add(value, squared_value, _visits, count);
+            _visits += count;
+        }
+
+        void update_stats_atomic(double value, double squared_value, size_t count)
+        {
+            _add_atomic(value, squared_value, count, std::integral_constant<bool, Statistics::lock_free>());
+        }
+
+        /// tree parallelization: count an in-flight visit as a loss, so that concurrent selections spread out
+        void add_virtual_loss(double loss)
+        {
+            _add_atomic(-loss, 0.0, 1, std::integral_constant<bool, Statistics::lock_free>());
+        }
+
+        /// tree parallelization: replace the virtual loss by the actual returns (one visit was already counted)
+        void revert_virtual_loss(double value, double squared_value, size_t count, double loss)
+        {
+            _add_atomic(value + loss, squared_value, count - 1, std::integral_constant<bool, Statistics::lock_free>());
         }
 
     protected:
-        node_ptr _parent;
-        std::vector<node_ptr> _children;
+        // statistics first: selection only reads the head of every action
+        Statistics _stats;
+        par::relaxed_atomic<size_t> _visits;
         ActionType _action;
-        double _value;
-        size_t _visits;
+        par::spin_lock _lock;
+        node_ptr _parent;
+        children_type _children;
+        ChildIndex<state_type> _index;
+        VisitSampler<typename Storage::template vector<size_t>> _sampler;
+        bool _attached;
+
+        static const state_type& _state_of(const node_ptr& node)
+        {
+            return *(node->state());
+        }
+
+        void _add_atomic(double value, double squared_value, size_t count, std::true_type)
+        {
+            _stats.add_atomic(value, squared_value);
+            if (count > 0)
+                _visits.fetch_add(count);
+        }
+
+        // the update reads the visits: statistics and visits change together under the lock
+        void _add_atomic(double value, double squared_value, size_t count, std::false_type)
+        {
+            std::lock_guard<par::spin_lock> lock(_lock);
+            update_stats(value, squared_value, count);
+        }
+
+        // positions shifted
+        void _children_moved()
+        {
+            _index.rebuild(_children, _state_of);
+            for (size_t i = 0; i < _children.size(); i++) {
+                if (!_children[i]->shared())
+                    _children[i]->slot() = i;
+            }
+            _sampler.invalidate();
+        }
     };
 
-    template <typename Params, typename State, typename StateInit, typename ValueInit, typename ActionValue, typename DefaultPolicy, typename Action, typename SelectionPolicy, typename OutcomeSelection>
-    class MCTSNode : public std::enable_shared_from_this<MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection>> {
+    /// Backup (see MeanBackup, MaxBackup, IncrementalMeanBackup) decides which returns go up the path of an iteration
+    /// and how the actions keep them (see backup_statistics)
+    template <typename Params, typename State, typename StateInit, typename ValueInit, typename ActionValue, typename DefaultPolicy, typename Action, typename SelectionPolicy, typename OutcomeSelection, typename Storage = SharedStorage, typename Backup = MeanBackup>
+    class MCTSNode {
     public:
-        using node_type = MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection>;
-        using action_type = MCTSAction<Params, node_type, OutcomeSelection, Action>;
+        using node_type = MCTSNode<Params, State, StateInit, ValueInit, ActionValue, DefaultPolicy, Action, SelectionPolicy, OutcomeSelection, Storage, Backup>;
+        using action_type = MCTSAction<Params, node_type, OutcomeSelection, Action, Storage, typename backup_statistics<Backup>::type>;
         using action_ptr = std::shared_ptr<action_type>;
         using node_ptr = std::shared_ptr<node_type>;
+        using state_type = State;
         using state_ptr = std::shared_ptr<State>;
+        using storage_type = Storage;
+        using storage_context = typename Storage::context;
+        using children_type = typename Storage::template vector<action_ptr>;
+        /// records the search statistics when Params::mcts_node::stats() is true, nothing otherwise
+        using stats_recorder = StatsRecorder<stats_enabled<Params>::value>;
 
-        MCTSNode(size_t rollout_depth = 1000, double gamma = 0.9) : _gamma(gamma), _visits(0), _rollout_depth(rollout_depth)
+        /// with arena storage, nodes are only destroyed when they own memory outside of the arena
+        static constexpr bool arena_finalize = has_child_hash<Action>::value || !std::is_trivially_destructible<typename Storage::template state<State>>::value;
+
+        /// nodes can be reached along several paths (see shares_nodes): traversals (see visit::) then skip the ones already visited
+        static constexpr bool shared_nodes = shares_nodes<OutcomeSelection>::value;
+
+        /// a root node; rollout_depth and gamma are stored once for the whole tree
+        MCTSNode(size_t rollout_depth = 1000, double gamma = 0.9) : _visits(0), _state(_storage, *StateInit()()), _children(Storage::template make_vector<action_ptr>(_storage)), _depth(0)
+        {
+            _init_root(rollout_depth, gamma);
+        }
+
+        MCTSNode(State state, size_t rollout_depth = 1000, double gamma = 0.9) : _visits(0), _state(_storage, state), _children(Storage::template make_vector<action_ptr>(_storage)), _depth(0)
+        {
+            _init_root(rollout_depth, gamma);
+        }
+
+        /// node living inside an existing tree (see MCTSAction::add_child)
+        MCTSNode(const State& state, const storage_context& storage, size_t depth) : _storage(storage.child()), _visits(0), _state(_storage, state), _children(Storage::template make_vector<action_ptr>(_storage)), _depth(depth)
         {
-            _state = StateInit()();
+            _storage.usage().nodes.fetch_add(1);
+            stats_recorder::node(_storage.stats(), depth);
         }
 
-        MCTSNode(State state, size_t rollout_depth = 1000, double gamma = 0.9) : _gamma(gamma), _visits(0), _rollout_depth(rollout_depth)
+        ~MCTSNode()
         {
-            _state = std::make_shared<State>(state);
+            _storage.usage().nodes.fetch_sub(1);
+            _storage.usage().actions.fetch_sub(_children.size());
         }
 
         action_ptr parent() const
@@ -115,14 +342,148 @@ namespace mcts {
             return _parent;
         }
 
-        std::vector<action_ptr> children() const
+        /// position of this node among the children of parent() (maintained by MCTSAction)
+        size_t slot() const
+        {
+            return _slot;
+        }
+
+        size_t& slot()
+        {
+            return _slot;
+        }
+
+        /// true once the node also hangs below another action than parent() (transpositions)
+        /// (set by the thread attaching it while others read it in child_visited())
+        bool shared() const
+        {
+            return _shared;
+        }
+
+        par::relaxed_atomic<bool>& shared()
+        {
+            return _shared;
+        }
+
+        const children_type& children() const
         {
             return _children;
         }
 
+        /// guards the actions when the tree is searched by several threads (e.g. for a Backup reading them)
+        par::spin_lock& mutex() const
+        {
+            return _lock;
+        }
+
+        /// the child for `action` (nullptr if not expanded yet), hashed when child_hash<Action> is specialized
+        action_ptr find_child(const Action& action)
+        {
+            auto it = _index.find(_children, action, _action_of);
+            return (it == _children.end()) ? nullptr : *it;
+        }
+
+        /// create the action `action` below this node, with empty statistics (e.g. when loading a tree)
+        action_ptr add_action(const Action& action)
+        {
+            return _add_action(action, 0.0);
+        }
+
+        const storage_context& storage() const
+        {
+            return _storage;
+        }
+
+        /// number of nodes and actions of the whole tree
+        const TreeUsage& usage() const
+        {
+            return _storage.usage();
+        }
+
+        /// cap the memory of the whole tree (see MemoryBudget); set it before searching
+        void set_memory_budget(const MemoryBudget& budget)
+        {
+            _storage.settings().memory = budget;
+        }
+
+        const MemoryBudget& memory_budget() const
+        {
+            return _storage.settings().memory;
+        }
+
+        /// bytes used by the whole tree: allocated arena bytes with ArenaStorage,
+        /// an estimate from the node and action counts otherwise
+        size_t memory_usage() const
+        {
+            return _memory_usage(std::integral_constant<bool, Storage::reference_counted>());
+        }
+
+        /// drop the least visited subtrees below this node until the tree has at most `max_nodes` nodes
+        /// (the actions keep their statistics), returns the number of nodes removed
+        /// - not thread-safe: no search may run on the tree meanwhile
+        /// - with arena storage the memory is recycled for the next nodes, and handles to the removed nodes dangle
+        /// - does nothing when the outcome selection shares nodes (see shares_nodes): a subtree can then also be
+        ///   reached through the part of the tree that is kept
+        size_t prune(size_t max_nodes)
+        {
+            if (shares_nodes<OutcomeSelection>::value)
+                return 0;
+
+            size_t nodes = _storage.usage().nodes;
+            if (nodes <= max_nodes)
+                return 0;
+            size_t excess = nodes - max_nodes;
+
+            // least visited nodes first: the visits of a subtree are at most the ones of its root,
+            // so removing every node up to `threshold` removes whole subtrees
+            std::vector<size_t> visits;
+            std::vector<const node_type*> stack(1, this);
+            while (!stack.empty()) {
+                const node_type* node = stack.back();
+                stack.pop_back();
+                for (const auto& action : node->_children) {
+                    for (const auto& child : action->children()) {
+                        visits.push_back(child->_visits);
+                        stack.push_back(child.get());
+                    }
+                }
+            }
+            if (visits.empty())
+                return 0;
+            size_t k = std::min(excess, visits.size()) - 1;
+            std::nth_element(visits.begin(), visits.begin() + k, visits.end());
+            size_t threshold = visits[k];
+
+            size_t removed = 0;
+            std::vector<node_type*> nodes_left(1, this);
+            while (!nodes_left.empty()) {
+                node_type* node = nodes_left.back();
+                nodes_left.pop_back();
+                for (const auto& action : node->_children) {
+                    action->remove_children_if([&](const node_ptr& child) {
+                        size_t v = child->_visits;
+                        if (v < threshold || (v == threshold && removed < excess)) {
+                            removed += _release_subtree(child);
+                            return true;
+                        }
+                        nodes_left.push_back(child.get());
+                        return false;
+                    });
+                }
+            }
+
+            return removed;
+        }
+
+        /// statistics of the searches on the whole tree (all zero unless Params::mcts_node::stats() is true)
+        StatsReport stats() const
+        {
+            return _storage.stats().report();
+        }
+
         state_ptr state() const
         {
-            return _state;
+            return _state.ptr();
         }
 
         size_t visits() const
@@ -130,105 +491,267 @@ namespace mcts {
             return _visits;
         }
 
-        size_t& visits()
+        par::relaxed_atomic<size_t>& visits()
         {
             return _visits;
         }
 
         size_t rollout_depth() const
         {
-            return _rollout_depth;
+            return _storage.settings().rollout_depth;
         }
 
         double gamma() const
         {
-            return _gamma;
+            return _storage.settings().gamma;
+        }
+
+        /// distance from the root the tree was grown from
+        size_t depth() const
+        {
+            return _depth;
         }
 
         template <typename RewardFunc>
         void compute(RewardFunc rfun, size_t iterations)
+        {
+            compute(rfun, IterationBudget(iterations));
+        }
+
+        /// search until `stop(root, iterations)` returns true (see budget.hpp), returns the number of iterations
+        /// with parallel_roots > 1, each worker evaluates its own copy of `stop` on its own tree, within its share
+        /// of the memory budget (see MemoryBudget::split); the merged tree is then pruned back under the budget
+        template <typename RewardFunc, typename Stop, typename std::enable_if<!std::is_arithmetic<Stop>::value, int>::type = 0>
+        size_t compute(RewardFunc rfun, Stop stop)
         {
             if (Params::mcts_node::parallel_roots() > 1) {
-                par::vector<node_ptr> roots;
-                par::replicate(Params::mcts_node::parallel_roots(), [&]() {
-                    node_ptr to_ret = std::make_shared<node_type>(*this->_state, this->_rollout_depth, this->_gamma);
-                    for (size_t k = 0; k < iterations; ++k) {
+                std::vector<node_ptr> roots(Params::mcts_node::parallel_roots());
+                std::atomic<size_t> iterations(0);
+                rng::GeneratorGuard guard;
+                const uint64_t salt = rng::next_salt();
+                // each tree is allocated on the NUMA node of its worker (see par::configure)
+                par::spread(0, roots.size(), [&](size_t worker) {
+                    // every tree draws from its own stream (a new one at every call), wherever it runs
+                    rng::seed_worker(worker, salt);
+                    node_ptr to_ret = _new_root(memory_budget().split(roots.size()));
+                    Stop worker_stop = stop;
+                    size_t k = 0;
+                    while (!worker_stop(*to_ret, k)) {
                         to_ret->iterate(rfun);
+                        k++;
                     }
 
-                    roots.push_back(to_ret);
+                    iterations += k;
+                    stats_recorder::thread_iterations(to_ret->_storage.stats(), k);
+                    roots[worker] = to_ret;
                 });
 
-                node_ptr cur_node = this->shared_from_this();
                 for (size_t i = 0; i < roots.size(); i++) {
-                    cur_node->merge_inplace(roots[i]);
+                    // the workers created the nodes copied here: they come with their statistics
+                    stats_recorder::uncounted(_storage.stats(), [&]() { merge_inplace(roots[i]); });
+                    stats_recorder::merge(_storage.stats(), roots[i]->_storage.stats());
                 }
+                _make_room(false);
+
+                return iterations;
             }
-            else {
-                for (size_t k = 0; k < iterations; ++k) {
-                    this->iterate(rfun);
-                }
+
+            size_t k = 0;
+            while (!stop(*this, k)) {
+                this->iterate(rfun);
+                k++;
             }
+            stats_recorder::thread_iterations(_storage.stats(), k);
+
+            return k;
         }
 
+        /// tree parallelization: all the workers grow this tree
+        /// (needs Params::mcts_node::virtual_loss(); RewardFunc, policies and states have to be thread-safe)
         template <typename RewardFunc>
-        void iterate(RewardFunc rfun)
+        void compute_shared(RewardFunc rfun, size_t iterations)
         {
-            std::vector<node_ptr> visited;
-            std::vector<double> rewards;
+            // blocks of iterations, each counted once in the statistics of the thread running it
+            const size_t blocks = std::min(iterations, 8 * std::max(par::threads(), size_t(1)));
+            par::loop(0, blocks, [&](size_t b) {
+                // clang-format off
+                size_t n = iterations / blocks + (b < iterations % blocks ? 1 : 0);
+                for (size_t k = 0; k < n; k++)
+                    this->iterate_shared(rfun);
+                stats_recorder::thread_iterations(_storage.stats(), n);
+                // clang-format on
+            });
+        }
 
-            node_ptr cur_node = this->shared_from_this();
-            visited.push_back(cur_node);
-            rewards.push_back(0.0);
-            // std::cout << "Iterate!" << std::endl;
+        /// with rollouts > 1 (leaf parallelization), that many simulations run in parallel from
+        /// the selected leaf and are backed up together
+        /// - the reward functor, the default policy and State::move (or move_batch) are then called
+        ///   concurrently, and must be thread-safe
+        /// - every rollout (every group of batch_width rollouts with batched transitions) works on its own
+        ///   copy of `rfun` and its own default policy: state kept in them is neither shared nor merged back
+        template <typename RewardFunc>
+        void iterate(RewardFunc rfun, size_t rollouts = 1)
+        {
+            _iterate<false>(rfun, rollouts);
+        }
 
-            do {
-                node_ptr prev_node = cur_node;
-                // std::cout << "(" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
-                action_ptr next_action = cur_node->_expand();
-                if (!next_action)
-                    break;
-                // std::cout << "Selected action: " << next_action->action() << std::endl;
-                cur_node = next_action->node();
-                rewards.push_back(rfun(prev_node->_state, next_action->action(), cur_node->_state));
-                // std::cout << "TO: (" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
-                visited.push_back(cur_node);
-            } while (!cur_node->_state->terminal() && cur_node->visits() > 0);
+        /// iterate() that can run concurrently with other iterate_shared() calls on the same tree
+        template <typename RewardFunc>
+        void iterate_shared(RewardFunc rfun, size_t rollouts = 1)
+        {
+            _iterate<true>(rfun, rollouts);
+        }
 
-            double value;
-            if (cur_node->_state->terminal()) {
-                value = 0.0;
-            }
-            else {
-                // std::cout << "Simulating: (" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
-                value = cur_node->_simulate(rfun);
-            }
+        /// evaluation-queue search: the leaves get their value from `evaluator` instead of a rollout
+        /// - up to `batch_size` descents are queued (each leaves a virtual loss on its path, see
+        ///   Params::mcts_node::virtual_loss()), then evaluated in a single call and backed up
+        /// - evaluator: void operator()(const State* const* states, double* values, size_t n)
+        ///   (see evaluator.hpp); terminal leaves are worth 0 and are not sent to it
+        /// runs `iterations` iterations, the last batch may be smaller
+        template <typename RewardFunc, typename Evaluator>
+        void compute_evaluated(RewardFunc rfun, Evaluator& evaluator, size_t iterations, size_t batch_size)
+        {
+            batch_size = std::max(batch_size, size_t(1));
+            std::vector<std::vector<PathStep>> paths(batch_size);
+            std::vector<const State*> leaves;
+            std::vector<size_t> queued;
+            std::vector<double> values;
+
+            for (size_t done = 0; done < iterations;) {
+                size_t n = std::min(batch_size, iterations - done);
+                typename stats_recorder::stopwatch watch;
+                uint64_t selection_ns = 0, expansion_ns = 0;
+
+                // concurrent descents: the virtual losses spread the queued leaves out
+                leaves.clear();
+                queued.clear();
+                bool grow = _make_room(true);
+                for (size_t k = 0; k < n; k++) {
+                    uint64_t selection = 0, expansion = 0;
+                    paths[k].clear();
+                    node_type* leaf = _descend<true>(rfun, paths[k], grow, watch, selection, expansion);
+                    selection_ns += selection;
+                    expansion_ns += expansion;
+                    if (!leaf->_state->terminal()) {
+                        leaves.push_back(leaf->_state.get());
+                        queued.push_back(k);
+                    }
+                }
+
+                values.assign(leaves.size(), 0.0);
+                if (!leaves.empty())
+                    evaluator(leaves.data(), values.data(), leaves.size());
+                uint64_t evaluation_ns = watch.lap();
 
-            for (int i = visited.size() - 1; i >= 0; i--) {
-                value = rewards[i] + _gamma * value;
-                visited[i]->_visits++;
-                if (visited[i]->_parent != nullptr)
-                    visited[i]->_parent->update_stats(value);
+                for (size_t k = 0, q = 0; k < n; k++) {
+                    Returns returns;
+                    if (q < queued.size() && queued[q] == k) {
+                        returns.value = values[q++];
+                        returns.squared_value = returns.value * returns.value;
+                    }
+                    _backup_path(paths[k], returns, std::true_type());
+                }
+                // the batch is shared evenly between its iterations
+                uint64_t backup_ns = watch.lap();
+                for (size_t k = 0; k < n; k++)
+                    stats_recorder::iteration(_storage.stats(), selection_ns / n, expansion_ns / n, evaluation_ns / n, backup_ns / n);
+                stats_recorder::thread_iterations(_storage.stats(), n);
+                done += n;
             }
         }
 
-        size_t max_depth(size_t parent_depth = 0)
+        /// rollouts on an asynchronous simulator (see async.hpp): up to `in_flight` iterations progress together
+        /// on the calling thread, each one suspended while its simulator step is pending
+        /// - the descent is unchanged (State::move through OutcomeSelection, `rfun` for its rewards) and
+        ///   leaves a virtual loss on the path (see Params::mcts_node::virtual_loss()) until the backup
+        /// - the rollout steps and their rewards come from `simulator`
+        /// runs `iterations` iterations
+        template <typename RewardFunc, typename Simulator>
+        void compute_async(RewardFunc rfun, Simulator& simulator, size_t iterations, size_t in_flight)
         {
-            if (this->_children.size() == 0) {
-                return parent_depth + 1;
-            }
-
-            size_t maxDepth = 0;
-            for (size_t k = 0; k < this->_children.size(); ++k) {
-                for (size_t j = 0; j < this->_children[k]->children().size(); j++) {
-                    size_t curDepth = this->_children[k]->children()[j]->max_depth(parent_depth + 1);
-                    if (maxDepth < curDepth) {
-                        maxDepth = curDepth;
-                    }
+            // the continuation of every suspended iteration
+            struct Suspended {
+                std::vector<PathStep> path;
+                double value, discount;
+                size_t steps;
+            };
+
+            in_flight = std::max(in_flight, size_t(1));
+            std::vector<Suspended> suspended(in_flight);
+            std::vector<size_t> free_slots;
+            for (size_t i = in_flight; i-- > 0;)
+                free_slots.push_back(i);
+
+            DefaultPolicy policy;
+            const size_t rollout_depth = this->rollout_depth();
+            const double gamma = this->gamma();
+            size_t started = 0, finished = 0;
+
+            auto finish = [&](size_t slot) {
+                Suspended& it = suspended[slot];
+                Returns returns;
+                returns.value = it.value;
+                returns.squared_value = it.value * it.value;
+                _backup_path(it.path, returns, std::true_type());
+                if (it.steps > 0)
+                    stats_recorder::rollout(_storage.stats(), it.steps);
+                free_slots.push_back(slot);
+                finished++;
+            };
+            auto step = [&](size_t slot, const State& from) {
+                simulator.submit(slot, from, _policy(policy, from, has_value_policy<DefaultPolicy, State>()));
+            };
+
+            while (finished < iterations) {
+                // new iterations run until their first simulator step
+                while (!free_slots.empty() && started < iterations) {
+                    size_t slot = free_slots.back();
+                    free_slots.pop_back();
+                    started++;
+
+                    Suspended& it = suspended[slot];
+                    it.path.clear();
+                    it.value = 0.0;
+                    it.discount = 1.0;
+                    it.steps = 0;
+                    typename stats_recorder::stopwatch watch;
+                    uint64_t selection_ns = 0, expansion_ns = 0;
+                    node_type* leaf = _descend<true>(rfun, it.path, _make_room(true), watch, selection_ns, expansion_ns);
+                    stats_recorder::iteration(_storage.stats(), selection_ns, expansion_ns, 0, 0);
+                    if (leaf->_state->terminal() || rollout_depth == 0)
+                        finish(slot);
+                    else
+                        step(slot, *leaf->_state);
                 }
+                if (finished == iterations)
+                    break;
+
+                // resume the iterations whose step is done
+                simulator.poll([&](size_t slot, const State& to, double reward) {
+                    Suspended& it = suspended[slot];
+                    it.value += it.discount * reward;
+                    it.discount *= gamma;
+                    it.steps++;
+                    if (to.terminal() || it.steps >= rollout_depth)
+                        finish(slot);
+                    else
+                        step(slot, to);
+                });
             }
+            stats_recorder::thread_iterations(_storage.stats(), iterations);
+        }
 
-            return maxDepth;
+        /// number of levels down to the deepest leaf (see visit.hpp for other tree-wide queries)
+        /// (stats() keeps a depth histogram of the created nodes without walking the tree)
+        size_t max_depth(size_t parent_depth = 0) const
+        {
+            size_t deepest = 0;
+            visit::pre_order(*this, [&](const node_type& node, size_t level) {
+                if (node._children.size() == 0)
+                    deepest = std::max(deepest, parent_depth + level + 1);
+            });
+
+            return deepest;
         }
 
         template <typename Value = GreedyValue>
@@ -236,42 +759,74 @@ namespace mcts {
         {
             if (_state->terminal())
                 return nullptr;
-            double v = -std::numeric_limits<double>::max();
-            action_ptr best_action = nullptr;
-
-            for (auto child : _children) {
-                double d = Value()(child);
-
-                if (d > v) {
-                    v = d;
-                    best_action = child;
-                }
-            }
-
-            return best_action;
+            return _best_child<Value>(has_batch_value<Value>());
         }
 
         node_ptr merge_with(const node_ptr& other)
         {
-            node_ptr to_ret = std::make_shared<node_type>(*this->_state, this->_rollout_depth, this->_gamma);
+            node_ptr to_ret = _new_root(memory_budget());
             to_ret->merge_inplace(other);
+            to_ret->_make_room(false);
 
             return to_ret;
         }
 
+        /// add the statistics of another search from the same state (e.g. a root-parallel worker):
+        /// matching actions and outcome states are merged all the way down, missing subtrees are copied
+        /// into this tree's storage (nothing is shared with `other` afterwards)
         void merge_inplace(const node_ptr& other)
         {
-            node_ptr to_ret = this->shared_from_this();
+            _visits += other->_visits;
 
-            for (auto child : other->_children) {
-                auto it = std::find_if(to_ret->_children.begin(), to_ret->_children.end(), [&](action_ptr const& p) { return *p == *child; });
-                if (it == to_ret->_children.end())
-                    to_ret->_children.push_back(child);
-                else {
-                    (*it)->value() += child->value();
-                    (*it)->visits() += child->visits();
-                }
+            std::vector<std::pair<action_ptr, action_ptr>> pairs;
+            for (const auto& child : other->_children) {
+                action_ptr mine = find_child(child->action());
+                pairs.emplace_back(mine ? mine : _add_action(child->action(), 0.0), child);
+            }
+
+            if (shares_nodes<OutcomeSelection>::value) {
+                // nodes can be reached along several paths: merge serially, each of them once
+                std::unordered_map<const node_type*, node_ptr> merged;
+                for (const auto& p : pairs)
+                    _merge_subtree(p.first, p.second, &merged);
+                return;
             }
+
+            // the subtrees below different actions are disjoint
+            par::loop(0, pairs.size(), [&](size_t i) {
+                // clang-format off
+                _merge_subtree(pairs[i].first, pairs[i].second, nullptr);
+                // clang-format on
+            });
+        }
+
+        /// tree reuse: the node reached through `action` with the observed outcome `state` becomes the root
+        /// of the next search, with all its statistics (nullptr if that outcome was never expanded)
+        /// - with reference-counted storage the node is detached (its subtree gets depths counting from it)
+        ///   and the rest of this tree released, on a background thread if `release_async` is set;
+        ///   that thread is detached: if the process exits before it is done, the rest is left to the OS
+        ///   (the destructors of the remaining states do not run)
+        /// - with arena storage, or when the outcome selection shares nodes (a node of the kept subtree
+        ///   can also hang below the released part), the subtree is copied into a fresh tree and this tree
+        ///   is released when its root is dropped; its nodes are then recorded again (see record_nodes())
+        node_ptr reroot(const Action& action, const State& state, bool release_async = false)
+        {
+            action_ptr act = find_child(action);
+            if (!act)
+                return nullptr;
+
+            node_ptr outcome = act->find_child(state);
+            if (!outcome)
+                return nullptr;
+
+            return _reroot(act, outcome, release_async, std::integral_constant<bool, Storage::reference_counted && !shares_nodes<OutcomeSelection>::value>());
+        }
+
+        /// tell the outcome selection about every node below this one (see has_record_node), e.g. after
+        /// the tree was copied or loaded: a transposition table starts empty in a new tree
+        void record_nodes()
+        {
+            _record_nodes(has_record_node<OutcomeSelection, node_type>());
         }
 
         // void print(size_t d = 0) const
@@ -288,24 +843,394 @@ namespace mcts {
         // }
 
     protected:
+        // declared first: the storage has to outlive everything allocated from it
+        storage_context _storage;
+        // then what the descent reads
+        par::relaxed_atomic<size_t> _visits;
+        typename Storage::template state<State> _state;
+        children_type _children;
+        mutable par::spin_lock _lock;
         action_ptr _parent;
-        std::vector<action_ptr> _children;
-        state_ptr _state;
-        double _gamma;
-        size_t _visits, _rollout_depth;
+        ChildIndex<Action> _index;
+        size_t _depth;
+        size_t _slot = 0;
+        par::relaxed_atomic<bool> _shared{false};
 
-        action_ptr _expand()
+        // a new tree from the state of this node, with the same settings and `budget`
+        node_ptr _new_root(const MemoryBudget& budget) const
         {
-            if (SelectionPolicy()(this->shared_from_this())) {
-                Action act = _state->next_action();
-                action_ptr next_action = std::make_shared<action_type>(act, this->shared_from_this(), ValueInit()(_state));
-                auto it = std::find_if(_children.begin(), _children.end(), [&](action_ptr const& p) { return *p == *next_action; });
-                if (_children.size() == 0 || it == _children.end()) {
-                    _children.push_back(next_action);
-                    return next_action;
+            node_ptr root = std::make_shared<node_type>(*_state, rollout_depth(), gamma());
+            root->set_memory_budget(budget);
+            return root;
+        }
+
+        void _init_root(size_t rollout_depth, double gamma)
+        {
+            _storage.settings().rollout_depth = rollout_depth;
+            _storage.settings().gamma = gamma;
+            _storage.usage().nodes.fetch_add(1);
+            stats_recorder::node(_storage.stats(), 0);
+        }
+
+        // one step of the path of an iteration: the node reached, the action taken to reach it and its reward
+        // (raw pointers: nodes are not released while the tree is searched)
+        struct PathStep {
+            node_type* node;
+            action_type* action;
+            double reward;
+        };
+
+        template <bool Concurrent, typename RewardFunc>
+        void _iterate(RewardFunc& rfun, size_t rollouts)
+        {
+            // with transpositions a node can have several parents: the backup follows the actions taken
+            PathScratch<PathStep> scratch;
+            std::vector<PathStep>& path = scratch.path();
+
+            // over the memory budget, the descent stays inside the existing tree
+            bool grow = _make_room(Concurrent);
+
+            typename stats_recorder::stopwatch watch;
+            uint64_t selection_ns = 0, expansion_ns = 0;
+            node_type* cur_node = _descend<Concurrent>(rfun, path, grow, watch, selection_ns, expansion_ns);
+
+            Returns returns;
+            if (!cur_node->_state->terminal()) {
+                // std::cout << "Simulating: (" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
+                if (rollouts <= 1) {
+                    returns.value = cur_node->_simulate(rfun);
+                    returns.squared_value = returns.value * returns.value;
+                }
+                else {
+                    std::vector<double> values(rollouts);
+                    cur_node->_simulate_all(rfun, values, has_batch_moves<State, Action>());
+                    returns.count = rollouts;
+                    for (double v : values) {
+                        returns.value += v;
+                        returns.squared_value += v * v;
+                    }
+                }
+            }
+            uint64_t rollout_ns = watch.lap();
+
+            _backup_path(path, returns, std::integral_constant<bool, Concurrent>());
+            stats_recorder::iteration(_storage.stats(), selection_ns, expansion_ns, rollout_ns, watch.lap());
+        }
+
+        // selection and expansion: fills `path` from this node down to the leaf reached, which it returns
+        // (a step counts as expansion when it reaches a node not visited yet, i.e. one it added to the tree)
+        template <bool Concurrent, typename RewardFunc>
+        node_type* _descend(RewardFunc& rfun, std::vector<PathStep>& path, bool grow, typename stats_recorder::stopwatch& watch, uint64_t& selection_ns, uint64_t& expansion_ns)
+        {
+            path.push_back(PathStep{this, _parent.get(), 0.0});
+            // std::cout << "Iterate!" << std::endl;
+
+            node_type* cur_node = this;
+            do {
+                node_type* prev_node = cur_node;
+                // std::cout << "(" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
+                action_ptr next_action = cur_node->template _expand<Concurrent>(grow);
+                if (!next_action)
+                    break;
+                // std::cout << "Selected action: " << next_action->action() << std::endl;
+                cur_node = _outcome<Concurrent>(next_action, grow).get();
+                path.push_back(PathStep{cur_node, next_action.get(), _reward(rfun, *prev_node->_state, next_action->action(), *cur_node->_state, has_value_reward<RewardFunc, State, Action>())});
+                // std::cout << "TO: (" << cur_node->_state->_x << ", " << cur_node->_state->_y << ")" << std::endl;
+                uint64_t step_ns = watch.lap();
+                if (cur_node->visits() == 0)
+                    expansion_ns += step_ns;
+                else
+                    selection_ns += step_ns;
+            } while (!cur_node->_state->terminal() && cur_node->visits() > 0);
+
+            return cur_node;
+        }
+
+        // a single pass from the leaf: the returns of each step are computed from the ones of the step below
+        template <typename Concurrent>
+        void _backup_path(const std::vector<PathStep>& path, Returns returns, Concurrent concurrent)
+        {
+            const double gamma = this->gamma();
+            Backup backup;
+            for (size_t i = path.size(); i-- > 0;) {
+                backup(*path[i].node, returns);
+                returns.discount(path[i].reward, gamma);
+                _backup(path[i], returns, i > 0, concurrent);
+            }
+        }
+
+        static void _backup(const PathStep& step, const Returns& returns, bool, std::false_type)
+        {
+            step.node->_add_visits(step.action, returns.count);
+            if (step.action != nullptr)
+                step.action->update_stats(returns.value, returns.squared_value, returns.count);
+        }
+
+        // nodes below the search root were reached through an action carrying a virtual loss
+        static void _backup(const PathStep& step, const Returns& returns, bool below_root, std::true_type)
+        {
+            step.node->_add_visits_locked(step.action, returns.count);
+            if (below_root)
+                step.action->revert_virtual_loss(returns.value, returns.squared_value, returns.count, Params::mcts_node::virtual_loss());
+            else if (step.action != nullptr)
+                step.action->update_stats_atomic(returns.value, returns.squared_value, returns.count);
+        }
+
+        // the node visits and their copy in the outcome sampler of `action` change together
+        // (the action on the path: with transpositions parent() can be another one, already released)
+        void _add_visits(action_type* action, size_t count)
+        {
+            _visits += count;
+            if (action)
+                action->child_visited(*this, count);
+        }
+
+        // shared nodes can be backed up through several actions at once;
+        // the visits change under the lock of the action, so that a concurrent rebuild of its sampler
+        // (sample_child()) sees them either before or after both updates
+        void _add_visits_locked(action_type* action, size_t count)
+        {
+            if (!action) {
+                _visits.fetch_add(count);
+                return;
+            }
+            std::lock_guard<par::spin_lock> lock(action->mutex());
+            _visits.fetch_add(count);
+            action->child_visited(*this, count);
+        }
+
+        template <bool Concurrent = false>
+        action_ptr _expand(bool grow = true)
+        {
+            std::unique_lock<par::spin_lock> lock(_lock, std::defer_lock);
+            if (Concurrent)
+                lock.lock();
+
+            action_ptr next_action = _expand_unlocked(grow);
+            if (next_action) {
+                _virtual_loss(next_action, std::integral_constant<bool, Concurrent>());
+                stats_recorder::branching(_storage.stats(), _children.size());
+            }
+            return next_action;
+        }
+
+        static void _virtual_loss(const action_ptr&, std::false_type) {}
+
+        static void _virtual_loss(const action_ptr& action, std::true_type)
+        {
+            action->add_virtual_loss(Params::mcts_node::virtual_loss());
+        }
+
+        template <bool Concurrent>
+        static node_ptr _outcome(const action_ptr& action, bool grow)
+        {
+            std::unique_lock<par::spin_lock> lock(action->mutex(), std::defer_lock);
+            if (Concurrent)
+                lock.lock();
+            if (grow || action->children().empty())
+                return action->node();
+
+            // a known outcome, in proportion to its visits
+            return action->sample_child();
+        }
+
+        // true if the descent may add nodes and actions, pruning first when the budget allows it
+        bool _make_room(bool concurrent)
+        {
+            const MemoryBudget& budget = _storage.settings().memory;
+            if (budget.max_nodes == 0 && budget.max_bytes == 0)
+                return true;
+            if (!_over_budget(budget))
+                return true;
+            // nodes reachable along several paths cannot be released (see prune())
+            if (budget.policy != MemoryPolicy::prune || concurrent || shares_nodes<OutcomeSelection>::value)
+                return false;
+
+            size_t nodes = _storage.usage().nodes;
+            double keep = 1.0 - budget.prune_fraction;
+            size_t target = nodes;
+            if (budget.max_nodes > 0)
+                target = std::min(target, static_cast<size_t>(keep * budget.max_nodes));
+            if (budget.max_bytes > 0)
+                target = std::min(target, static_cast<size_t>(keep * nodes * (double(budget.max_bytes) / double(std::max(memory_usage(), size_t(1))))));
+            prune(target);
+            return !_over_budget(budget);
+        }
+
+        bool _over_budget(const MemoryBudget& budget) const
+        {
+            return (budget.max_nodes > 0 && _storage.usage().nodes >= budget.max_nodes) || (budget.max_bytes > 0 && memory_usage() >= budget.max_bytes);
+        }
+
+        size_t _memory_usage(std::true_type) const
+        {
+            // object, control block and the handle held by the parent
+            const size_t block = 2 * sizeof(void*);
+            const size_t state = std::is_same<typename Storage::template state<State>, PointerState<State, Storage>>::value ? sizeof(State) + block : 0;
+            const size_t node = sizeof(node_type) + block + sizeof(node_ptr) + state;
+            const size_t action = sizeof(action_type) + block + sizeof(action_ptr);
+            return _storage.usage().nodes * node + _storage.usage().actions * action;
+        }
+
+        size_t _memory_usage(std::false_type) const
+        {
+            return _storage.arena()->bytes_allocated();
+        }
+
+        // the subtree below a detached node: released with its last reference, or destroyed here (arena)
+        // returns its number of nodes
+        static size_t _release_subtree(const node_ptr& root)
+        {
+            std::vector<node_ptr> nodes(1, root);
+            std::vector<action_ptr> actions;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                for (const auto& action : nodes[i]->_children) {
+                    actions.push_back(action);
+                    for (const auto& child : action->children())
+                        nodes.push_back(child);
+                }
+            }
+
+            if (Storage::reference_counted)
+                return nodes.size();
+
+            const storage_context& storage = root->_storage;
+            for (const auto& action : actions)
+                Storage::template destroy<action_type, action_type::arena_finalize>(storage, action);
+            for (const auto& node : nodes) {
+                _release_state(storage, node->_state);
+                Storage::template destroy<node_type, arena_finalize>(storage, node);
+            }
+            return nodes.size();
+        }
+
+        static void _release_state(const storage_context& storage, PointerState<State, Storage>& state)
+        {
+            Storage::destroy(storage, state.ptr());
+        }
+
+        static void _release_state(const storage_context&, InlineState<State>&) {}
+
+        node_ptr _reroot(const action_ptr& action, const node_ptr& outcome, bool release_async, std::true_type)
+        {
+            node_ptr root = outcome;
+            root->_parent = nullptr;
+            action->remove_child(std::find(action->children().begin(), action->children().end(), outcome));
+            root->_shift_depths(root->_depth);
+
+            std::shared_ptr<children_type> garbage = std::make_shared<children_type>(std::move(_children));
+            _children = Storage::template make_vector<action_ptr>(_storage);
+            _index.rebuild(_children, _action_of);
+            _storage.usage().actions.fetch_sub(garbage->size());
+            if (release_async)
+                par::detach([garbage = std::move(garbage)]() mutable { garbage.reset(); });
+
+            return root;
+        }
+
+        node_ptr _reroot(const action_ptr&, const node_ptr& outcome, bool, std::false_type)
+        {
+            node_ptr root = std::make_shared<node_type>(*(outcome->_state), rollout_depth(), gamma());
+            root->set_memory_budget(memory_budget());
+            root->merge_inplace(outcome);
+            root->record_nodes();
+            return root;
+        }
+
+        // depths in the subtree of a new root count from it (no shared nodes: each is reached once)
+        void _shift_depths(size_t offset)
+        {
+            if (offset == 0)
+                return;
+            std::vector<node_type*> stack(1, this);
+            while (!stack.empty()) {
+                node_type* node = stack.back();
+                stack.pop_back();
+                node->_depth -= offset;
+                for (const auto& action : node->_children) {
+                    for (const auto& child : action->children())
+                        stack.push_back(child.get());
                 }
+            }
+        }
 
-                return (*it);
+        void _record_nodes(std::false_type) {}
+
+        void _record_nodes(std::true_type)
+        {
+            // each node once, however many paths lead to it
+            std::unordered_set<const node_type*> seen;
+            std::vector<const node_type*> stack(1, this);
+            while (!stack.empty()) {
+                const node_type* node = stack.back();
+                stack.pop_back();
+                for (const auto& action : node->_children) {
+                    for (const auto& child : action->children()) {
+                        if (!seen.insert(child.get()).second)
+                            continue;
+                        OutcomeSelection::record(child);
+                        stack.push_back(child.get());
+                    }
+                }
+            }
+        }
+
+        action_ptr _add_action(const Action& act, double value)
+        {
+            action_ptr action = Storage::template make<action_type, action_type::arena_finalize>(_storage, act, make_ref(this), value);
+            _index.insert(act, _children.size());
+            _children.push_back(action);
+            _storage.usage().actions.fetch_add(1);
+            stats_recorder::action(_storage.stats());
+            return action;
+        }
+
+        // merge the subtree below `other` into `action` (explicit stack: trees can be very deep)
+        // `merged` (with transpositions) maps the nodes of the other tree that were already merged to ours
+        static void _merge_subtree(const action_ptr& action, const action_ptr& other, std::unordered_map<const node_type*, node_ptr>* merged)
+        {
+            std::vector<std::pair<action_ptr, action_ptr>> stack(1, std::make_pair(action, other));
+            while (!stack.empty()) {
+                action_ptr mine = stack.back().first;
+                action_ptr theirs = stack.back().second;
+                stack.pop_back();
+
+                mine->update_stats(theirs->value(), theirs->squared_value(), theirs->visits());
+
+                for (const auto& other_node : theirs->children()) {
+                    if (merged) {
+                        auto m = merged->find(other_node.get());
+                        if (m != merged->end()) {
+                            if (!mine->find_child(*(m->second->_state)))
+                                mine->attach_child(m->second);
+                            continue;
+                        }
+                    }
+
+                    node_ptr node = mine->find_child(*(other_node->_state));
+                    if (!node)
+                        node = mine->add_child(*(other_node->_state));
+                    if (merged)
+                        (*merged)[other_node.get()] = node;
+                    node->_add_visits(mine.get(), other_node->_visits);
+
+                    for (const auto& other_action : other_node->_children) {
+                        action_ptr next = node->find_child(other_action->action());
+                        stack.emplace_back(next ? next : node->_add_action(other_action->action(), 0.0), other_action);
+                    }
+                }
+            }
+        }
+
+        action_ptr _expand_unlocked(bool grow)
+        {
+            if (grow && SelectionPolicy()(make_ref(this))) {
+                Action act = _state->next_action();
+                action_ptr action = find_child(act);
+                if (!action)
+                    return _add_action(act, ValueInit()(_state.ptr()));
+
+                return action;
             }
 
             return _select_action();
@@ -315,11 +1240,17 @@ namespace mcts {
         {
             if (_state->terminal())
                 return nullptr;
+            return _best_child<ActionValue>(has_batch_value<ActionValue>());
+        }
+
+        template <typename Value>
+        action_ptr _best_child(std::false_type)
+        {
             double v = -std::numeric_limits<double>::max();
             action_ptr best_action = nullptr;
 
-            for (auto child : _children) {
-                double d = ActionValue()(child);
+            for (const auto& child : _children) {
+                double d = Value()(child);
 
                 if (d > v) {
                     v = d;
@@ -330,33 +1261,191 @@ namespace mcts {
             return best_action;
         }
 
+        // batched values: the statistics of the children are gathered into per-thread arrays first
+        template <typename Value>
+        action_ptr _best_child(std::true_type)
+        {
+            size_t n = _children.size();
+            SelectionScratch& scratch = SelectionScratch::local();
+            scratch.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                scratch.values[i] = _children[i]->value();
+                scratch.visits[i] = double(_children[i]->visits());
+            }
+            Value()(double(_visits), scratch.values.data(), scratch.visits.data(), scratch.scores.data(), n);
+
+            double v = -std::numeric_limits<double>::max();
+            size_t best = n;
+            for (size_t i = 0; i < n; i++) {
+                if (scratch.scores[i] > v) {
+                    v = scratch.scores[i];
+                    best = i;
+                }
+            }
+
+            return (best == n) ? nullptr : _children[best];
+        }
+
+        static Action _action_of(const action_ptr& action)
+        {
+            return action->action();
+        }
+
         template <typename RewardFunc>
         double _simulate(RewardFunc rfun)
         {
             double discount = 1.0;
             double reward = 0.0;
 
-            state_ptr cur_state = _state;
+            // the rollout runs on two stack-resident states (no allocation per step)
+            DefaultPolicy policy;
+            ScratchStates<State> scratch;
+            const State* cur_state = _state.get();
+            const size_t rollout_depth = this->rollout_depth();
+            const double gamma = this->gamma();
+            size_t steps = 0;
 
-            for (size_t k = 0; k < _rollout_depth; ++k) {
+            for (size_t k = 0; k < rollout_depth; ++k) {
+                steps++;
                 // Choose action according to default policy
-                Action action = DefaultPolicy()(cur_state);
-                state_ptr prev_state = cur_state;
+                Action action = _policy(policy, *cur_state, has_value_policy<DefaultPolicy, State>());
+                const State* prev_state = cur_state;
 
                 // Update state
-                cur_state = std::make_shared<State>(cur_state->move(action));
+                cur_state = &scratch.move(*prev_state, action);
 
                 // Get value from (PO)MDP
-                reward += discount * rfun(prev_state, action, cur_state);
+                reward += discount * _reward(rfun, *prev_state, action, *cur_state, has_value_reward<RewardFunc, State, Action>());
 
                 // Check if terminal state
                 if (cur_state->terminal())
                     break;
-                discount *= _gamma;
+                discount *= gamma;
             }
+            stats_recorder::rollout(_storage.stats(), steps);
 
             return reward;
         }
+
+        // leaf parallelization: one rollout per entry of `values`
+        template <typename RewardFunc>
+        void _simulate_all(RewardFunc& rfun, std::vector<double>& values, std::false_type)
+        {
+            par::loop(0, values.size(), [&](size_t k) {
+                // clang-format off
+                values[k] = _simulate(rfun);
+                // clang-format on
+            });
+        }
+
+        // with batched transitions, the rollouts run in lockstep by groups of batch_width (the groups in parallel)
+        template <typename RewardFunc>
+        void _simulate_all(RewardFunc& rfun, std::vector<double>& values, std::true_type)
+        {
+            const size_t width = batch_width;
+            const size_t groups = (values.size() + width - 1) / width;
+            par::loop(0, groups, [&](size_t g) {
+                // clang-format off
+                size_t begin = g * width;
+                _simulate_batch(rfun, values.data() + begin, std::min(width, values.size() - begin));
+                // clang-format on
+            });
+        }
+
+        /// number of rollouts stepped together through State::move_batch
+        static constexpr size_t batch_width = 16;
+
+        // `n` rollouts from this node in lockstep, same returns as `n` calls to _simulate()
+        template <typename RewardFunc>
+        void _simulate_batch(RewardFunc rfun, double* values, size_t n)
+        {
+            // nothing below calls into par::, so the lanes of this thread cannot be reused meanwhile
+            BatchScratch<State, Action>& b = BatchScratch<State, Action>::local();
+            b.reset(*_state, n);
+            DefaultPolicy policy;
+            const size_t rollout_depth = this->rollout_depth();
+            const double gamma = this->gamma();
+            double discount = 1.0;
+            size_t active = n;
+
+            for (size_t k = 0; k < rollout_depth && active > 0; ++k) {
+                _policy_batch(policy, b, active, has_batch_policy<DefaultPolicy, State, Action>());
+                State::move_batch(b.from.data(), b.actions.data(), b.to.data(), active);
+                _reward_batch(rfun, b, active, has_batch_reward<RewardFunc, State, Action>());
+                State::terminal_batch(b.to.data(), b.terminal.get(), active);
+
+                // the running lanes continue from their new state, into the slot of the previous one
+                size_t running = 0;
+                for (size_t i = 0; i < active; i++) {
+                    size_t lane = b.lanes[i];
+                    b.returns[lane] += discount * b.rewards[i];
+                    b.steps[lane]++;
+                    if (b.terminal[i])
+                        continue;
+                    const State* prev = b.from[i];
+                    b.from[running] = b.to[i];
+                    b.to[running] = const_cast<State*>(prev);
+                    b.lanes[running] = lane;
+                    running++;
+                }
+                active = running;
+                discount *= gamma;
+            }
+
+            for (size_t i = 0; i < n; i++) {
+                values[i] = b.returns[i];
+                stats_recorder::rollout(_storage.stats(), b.steps[i]);
+            }
+        }
+
+        static void _policy_batch(DefaultPolicy& policy, BatchScratch<State, Action>& b, size_t n, std::true_type)
+        {
+            policy(b.from.data(), b.actions.data(), n);
+        }
+
+        static void _policy_batch(DefaultPolicy& policy, BatchScratch<State, Action>& b, size_t n, std::false_type)
+        {
+            for (size_t i = 0; i < n; i++)
+                b.actions[i] = _policy(policy, *b.from[i], has_value_policy<DefaultPolicy, State>());
+        }
+
+        template <typename RewardFunc>
+        static void _reward_batch(RewardFunc& rfun, BatchScratch<State, Action>& b, size_t n, std::true_type)
+        {
+            rfun(b.from.data(), b.actions.data(), b.to.data(), b.rewards.data(), n);
+        }
+
+        template <typename RewardFunc>
+        static void _reward_batch(RewardFunc& rfun, BatchScratch<State, Action>& b, size_t n, std::false_type)
+        {
+            for (size_t i = 0; i < n; i++)
+                b.rewards[i] = _reward(rfun, *b.from[i], b.actions[i], *b.to[i], has_value_reward<RewardFunc, State, Action>());
+        }
+
+        // reward functors either take `const State&` or (legacy) `std::shared_ptr<State>`;
+        // the latter get non-owning handles that are only valid during the call
+
+        template <typename RewardFunc>
+        static double _reward(RewardFunc& rfun, const State& from, const Action& action, const State& to, std::true_type)
+        {
+            return rfun(from, action, to);
+        }
+
+        template <typename RewardFunc>
+        static double _reward(RewardFunc& rfun, const State& from, const Action& action, const State& to, std::false_type)
+        {
+            return rfun(make_ref(const_cast<State*>(&from)), action, make_ref(const_cast<State*>(&to)));
+        }
+
+        static Action _policy(DefaultPolicy& policy, const State& state, std::true_type)
+        {
+            return policy(state);
+        }
+
+        static Action _policy(DefaultPolicy& policy, const State& state, std::false_type)
+        {
+            return policy(make_ref(const_cast<State*>(&state)));
+        }
     };
 } // namespace mcts
 
@@ -0,0 +1,285 @@
+#ifndef MCTS_VISIT_HPP
+#define MCTS_VISIT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <mcts/parallel.hpp>
+#include <mcts/traits.hpp>
+
+namespace mcts {
+
+    /// Traversals of the nodes of a tree (MCTSNode), with explicit stacks: trees can be very deep
+    /// - `f(node, level)` is called for every node, `level` counting the steps from the node the traversal started at
+    /// - the outcome nodes below a node are the children of each of its actions, in order
+    /// - with transpositions (Node::shared_nodes) a node reached along several paths is visited once,
+    ///   at the first level it is reached at
+    namespace visit {
+
+        namespace detail {
+            template <typename Node, typename = void>
+            struct shared_nodes : std::false_type {
+            };
+
+            template <typename Node>
+            struct shared_nodes<Node, void_t<decltype(Node::shared_nodes)>> : std::integral_constant<bool, Node::shared_nodes> {
+            };
+
+            // the nodes visited so far, only tracked when nodes can be shared
+            template <typename Node, bool Shared = shared_nodes<Node>::value>
+            struct seen_set {
+                bool insert(const Node*)
+                {
+                    return true;
+                }
+            };
+
+            template <typename Node>
+            struct seen_set<Node, true> {
+                std::unordered_set<const Node*> nodes;
+
+                bool insert(const Node* node)
+                {
+                    return nodes.insert(node).second;
+                }
+            };
+
+            // pre-order and level-order visitors may return false to skip the nodes below
+            template <typename F, typename Node>
+            bool call(F& f, const Node& node, size_t level, std::true_type)
+            {
+                return f(node, level);
+            }
+
+            template <typename F, typename Node>
+            bool call(F& f, const Node& node, size_t level, std::false_type)
+            {
+                f(node, level);
+                return true;
+            }
+
+            template <typename F, typename Node>
+            bool call(F& f, const Node& node, size_t level)
+            {
+                return call(f, node, level, std::is_same<decltype(f(node, level)), bool>());
+            }
+
+            // push the outcome nodes below `node`, the first one on top
+            template <typename Node>
+            void push_children(std::vector<std::pair<const Node*, size_t>>& stack, const Node& node, size_t level)
+            {
+                const auto& actions = node.children();
+                for (size_t i = actions.size(); i-- > 0;) {
+                    const auto& outcomes = actions[i]->children();
+                    for (size_t j = outcomes.size(); j-- > 0;)
+                        stack.emplace_back(outcomes[j].get(), level + 1);
+                }
+            }
+        } // namespace detail
+
+        /// every node before the nodes below it (depth-first); `f` returning false skips the nodes below
+        template <typename Node, typename F>
+        void pre_order(const Node& root, F f)
+        {
+            std::vector<std::pair<const Node*, size_t>> stack(1, std::make_pair(&root, size_t(0)));
+            detail::seen_set<Node> seen;
+            while (!stack.empty()) {
+                const Node* node = stack.back().first;
+                size_t level = stack.back().second;
+                stack.pop_back();
+                if (!seen.insert(node))
+                    continue;
+                if (detail::call(f, *node, level))
+                    detail::push_children(stack, *node, level);
+            }
+        }
+
+        /// every node after all the nodes below it (depth-first)
+        template <typename Node, typename F>
+        void post_order(const Node& root, F f)
+        {
+            // a node stays on the stack, marked as expanded, while the nodes below it are visited
+            struct Entry {
+                const Node* node;
+                size_t level;
+                bool expanded;
+            };
+            std::vector<Entry> stack(1, Entry{&root, 0, false});
+            std::vector<std::pair<const Node*, size_t>> below;
+            detail::seen_set<Node> seen;
+            while (!stack.empty()) {
+                Entry& top = stack.back();
+                if (top.expanded) {
+                    f(*top.node, top.level);
+                    stack.pop_back();
+                    continue;
+                }
+                if (!seen.insert(top.node)) {
+                    stack.pop_back();
+                    continue;
+                }
+                top.expanded = true;
+                below.clear();
+                detail::push_children(below, *top.node, top.level);
+                for (const auto& b : below)
+                    stack.push_back(Entry{b.first, b.second, false});
+            }
+        }
+
+        /// every node of a level before the ones of the next level (breadth-first);
+        /// `f` returning false skips the nodes below
+        template <typename Node, typename F>
+        void level_order(const Node& root, F f)
+        {
+            std::deque<std::pair<const Node*, size_t>> queue(1, std::make_pair(&root, size_t(0)));
+            detail::seen_set<Node> seen;
+            while (!queue.empty()) {
+                const Node* node = queue.front().first;
+                size_t level = queue.front().second;
+                queue.pop_front();
+                if (!seen.insert(node) || !detail::call(f, *node, level))
+                    continue;
+                for (const auto& action : node->children()) {
+                    for (const auto& child : action->children())
+                        queue.emplace_back(child.get(), level + 1);
+                }
+            }
+        }
+
+        /// parallel reduction over all the nodes: `visit(node, level, acc)` for every node, in no particular order
+        /// - the tree is split level by level until there are enough subtrees for the worker threads (see par::);
+        ///   each subtree is reduced into its own copy of `init`, then `combine(result, acc)` gathers them in order
+        /// - `init` has to be neutral for `combine` (e.g. 0 for a sum)
+        /// - serial when nodes can be shared (subtrees overlap)
+        template <typename Node, typename T, typename Visit, typename Combine>
+        T parallel_reduce(const Node& root, const T& init, Visit visit, Combine combine)
+        {
+            if (detail::shared_nodes<Node>::value) {
+                T result = init;
+                pre_order(root, [&](const Node& node, size_t level) { visit(node, level, result); });
+                return result;
+            }
+
+            const size_t tasks = 8 * std::max(par::threads(), size_t(1));
+
+            // the levels above the split are visited here
+            T result = init;
+            std::vector<std::pair<const Node*, size_t>> frontier(1, std::make_pair(&root, size_t(0)));
+            while (!frontier.empty() && frontier.size() < tasks) {
+                std::vector<std::pair<const Node*, size_t>> next;
+                for (const auto& p : frontier) {
+                    visit(*p.first, p.second, result);
+                    for (const auto& action : p.first->children()) {
+                        for (const auto& child : action->children())
+                            next.emplace_back(child.get(), p.second + 1);
+                    }
+                }
+                frontier.swap(next);
+            }
+
+            std::vector<T> partial(frontier.size(), init);
+            par::loop(0, frontier.size(), [&](size_t i) {
+                // clang-format off
+                size_t offset = frontier[i].second;
+                pre_order(*frontier[i].first, [&](const Node& node, size_t level) { visit(node, offset + level, partial[i]); });
+                // clang-format on
+            });
+            for (const T& p : partial)
+                combine(result, p);
+            return result;
+        }
+
+        /// number of nodes
+        template <typename Node>
+        size_t node_count(const Node& root, bool parallel = false)
+        {
+            auto visit = [](const Node&, size_t, size_t& count) { count++; };
+            if (parallel)
+                return parallel_reduce(root, size_t(0), visit, [](size_t& a, size_t b) { a += b; });
+            size_t count = 0;
+            pre_order(root, [&](const Node& node, size_t level) { visit(node, level, count); });
+            return count;
+        }
+
+        /// number of nodes at every level below `root` (root at 0)
+        template <typename Node>
+        std::vector<size_t> depth_histogram(const Node& root, bool parallel = false)
+        {
+            auto visit = [](const Node&, size_t level, std::vector<size_t>& histogram) {
+                if (histogram.size() <= level)
+                    histogram.resize(level + 1, 0);
+                histogram[level]++;
+            };
+            std::vector<size_t> histogram;
+            if (parallel) {
+                return parallel_reduce(root, histogram, visit, [](std::vector<size_t>& a, const std::vector<size_t>& b) {
+                    if (a.size() < b.size())
+                        a.resize(b.size(), 0);
+                    for (size_t i = 0; i < b.size(); i++)
+                        a[i] += b[i];
+                });
+            }
+            pre_order(root, [&](const Node& node, size_t level) { visit(node, level, histogram); });
+            return histogram;
+        }
+
+        /// bytes of the node and action objects below `root` and of their children arrays
+        /// (without allocator overhead and states held outside the nodes, see MCTSNode::memory_usage)
+        template <typename Node>
+        size_t memory_footprint(const Node& root, bool parallel = false)
+        {
+            using action_type = typename Node::action_type;
+            auto visit = [](const Node& node, size_t, size_t& bytes) {
+                bytes += sizeof(Node) + node.children().capacity() * sizeof(typename Node::action_ptr);
+                for (const auto& action : node.children())
+                    bytes += sizeof(action_type) + action->children().capacity() * sizeof(typename Node::node_ptr);
+            };
+            if (parallel)
+                return parallel_reduce(root, size_t(0), visit, [](size_t& a, size_t b) { a += b; });
+            size_t bytes = 0;
+            pre_order(root, [&](const Node& node, size_t level) { visit(node, level, bytes); });
+            return bytes;
+        }
+
+        /// a step of the principal variation: the action taken and the outcome node it led to
+        template <typename Node>
+        struct PVStep {
+            typename std::decay<decltype(std::declval<const typename Node::action_type&>().action())>::type action;
+            const Node* node;
+        };
+
+        /// the line of play the search expects: the most visited action, then its most visited outcome,
+        /// down to a node without actions (at most `max_length` steps)
+        template <typename Node>
+        std::vector<PVStep<Node>> principal_variation(const Node& root, size_t max_length = size_t(-1))
+        {
+            std::vector<PVStep<Node>> line;
+            const Node* node = &root;
+            while (line.size() < max_length) {
+                typename Node::action_ptr best = nullptr;
+                for (const auto& action : node->children()) {
+                    if (!action->children().empty() && (!best || action->visits() > best->visits()))
+                        best = action;
+                }
+                if (!best)
+                    break;
+
+                const Node* next = nullptr;
+                for (const auto& child : best->children()) {
+                    if (!next || child->visits() > next->visits())
+                        next = child.get();
+                }
+                line.push_back(PVStep<Node>{best->action(), next});
+                node = next;
+            }
+            return line;
+        }
+    } // namespace visit
+} // namespace mcts
+
+#endif
@@ -0,0 +1,69 @@
+// Asynchronous rollouts on a slow simulator (continuous navigation of src/toy_sim.cpp)
+// - every simulator step takes `latency` to come back (LatencySimulator), the search runs on one thread
+// - for every number of iterations in flight: iterations/s and simulator steps/s
+//
+// usage: async [--iterations n] [--latency us] [--depth n] (CSV on stdout)
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <mcts/uct.hpp>
+#include <mcts/async.hpp>
+
+#include "problems.hpp"
+
+struct Params {
+    struct uct {
+        MCTS_PARAM(double, c, 10.0);
+    };
+
+    struct spw {
+        MCTS_PARAM(double, a, 0.5);
+    };
+
+    struct cont_outcome {
+        MCTS_PARAM(double, b, 0.6);
+    };
+
+    struct mcts_node {
+        MCTS_PARAM(size_t, parallel_roots, 1);
+        MCTS_PARAM(double, virtual_loss, 10.0);
+    };
+};
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 500, depth = 10;
+    std::chrono::microseconds latency(200);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--iterations")
+            iterations = std::stoul(value);
+        else if (arg == "--latency")
+            latency = std::chrono::microseconds(std::stoul(value));
+        else if (arg == "--depth")
+            depth = std::stoul(value);
+        else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    using tree_type = mcts::MCTSNode<Params, toy::State, mcts::SimpleStateInit<toy::State>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<toy::State, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>;
+
+    std::cout << "in_flight,iterations_per_sec,steps_per_sec" << std::endl;
+    for (size_t in_flight : {1, 4, 16, 64, 256}) {
+        mcts::rng::seed(42);
+        mcts::LatencySimulator<toy::State, double, toy::Reward> simulator(toy::Reward(), latency);
+        auto tree = std::make_shared<tree_type>(toy::State(), depth, 0.9);
+
+        auto start = std::chrono::steady_clock::now();
+        tree->compute_async(toy::Reward(), simulator, iterations, in_flight);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << in_flight << "," << iterations / seconds << "," << simulator.transitions() / seconds << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+// Batched leaf evaluation benchmark on the trap problem (src/benchmarks/trap.cpp)
+// - leaves are valued by a stand-in evaluator (SimulatedEvaluator) with a latency per call and a cost per state
+// - for every batch size: iterations/s and how often the best action is the right one
+//
+// usage: evaluator [--iterations n] [--latency us] [--cost us] [--runs n] (CSV on stdout)
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <mcts/uct.hpp>
+#include <mcts/evaluator.hpp>
+
+#include "problems.hpp"
+
+using trap::Params;
+using trap::Reward;
+using trap::State;
+
+// what is left to gain from a state one step before the end (the second step is the last one)
+struct Heuristic {
+    double operator()(const State& state) const
+    {
+        return (state._x > 0.7) ? 100.0 : 70.0;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 5000, runs = 10;
+    mcts::SimulatedEvaluator<Heuristic> evaluator;
+    evaluator.latency = std::chrono::microseconds(100);
+    evaluator.cost_per_state = std::chrono::microseconds(1);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--iterations")
+            iterations = std::stoul(value);
+        else if (arg == "--latency")
+            evaluator.latency = std::chrono::microseconds(std::stoul(value));
+        else if (arg == "--cost")
+            evaluator.cost_per_state = std::chrono::microseconds(std::stoul(value));
+        else if (arg == "--runs")
+            runs = std::stoul(value);
+        else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    using tree_type = mcts::MCTSNode<Params, State, mcts::SimpleStateInit<State>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<State, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>;
+
+    std::cout << "batch,iterations_per_sec,calls,right" << std::endl;
+    for (size_t batch : {1, 2, 4, 8, 16, 32, 64}) {
+        double seconds = 0.0;
+        size_t right = 0;
+        evaluator.calls = 0;
+        for (size_t run = 0; run < runs; run++) {
+            mcts::rng::seed(run + 1);
+            auto tree = std::make_shared<tree_type>(State(), 2, 1.0);
+            auto start = std::chrono::steady_clock::now();
+            tree->compute_evaluated(Reward(), evaluator, iterations, batch);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // 70 now and 100 at the next step
+            auto best = tree->best_action();
+            if (best != nullptr && best->action() > 0.7 && best->action() < 0.99)
+                right++;
+        }
+        std::cout << batch << "," << (iterations * runs) / seconds << "," << evaluator.calls / runs << "," << double(right) / runs << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Outcome sampling benchmark: ContinuousOutcomeSelect once progressive widening stopped adding outcomes
+// - one action with n outcome nodes, each draw is followed by the visit of the outcome drawn (as in a backup)
+// - "scan": sum of the visits and linear walk at every draw (the previous implementation)
+// - "fenwick": MCTSAction::sample_child (O(log n))
+//
+// usage: outcomes [draws] (CSV on stdout: children,method,ns_per_draw)
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <mcts/uct.hpp>
+
+#include "problems.hpp"
+
+// every move draws a new outcome (the settings of the trap problem are only used for the outcome sampling)
+struct State {
+    double _x;
+
+    State(double x = 0.0) : _x(x) {}
+
+    double next_action() const
+    {
+        return 0.0;
+    }
+
+    double random_action() const
+    {
+        return 0.0;
+    }
+
+    State move(double) const
+    {
+        return State(mcts::rng::uniform());
+    }
+
+    bool terminal() const
+    {
+        return false;
+    }
+
+    bool operator==(const State& other) const
+    {
+        return _x == other._x;
+    }
+};
+
+using node_type = mcts::MCTSNode<trap::Params, State, mcts::SimpleStateInit<State>, mcts::SimpleValueInit, mcts::UCTValue<trap::Params>, mcts::UniformRandomPolicy<State, double>, double, mcts::SPWSelectPolicy<trap::Params>, mcts::ContinuousOutcomeSelect<trap::Params>>;
+using action_ptr = node_type::action_ptr;
+using node_ptr = std::shared_ptr<node_type>;
+
+node_ptr scan(const action_ptr& action)
+{
+    size_t sum = 0;
+    for (const auto& child : action->children())
+        sum += child->visits();
+    if (sum == 0)
+        return action->children()[mcts::rng::below(action->children().size())];
+    size_t r = mcts::rng::below(sum);
+    size_t p = 0;
+    for (const auto& child : action->children()) {
+        p += child->visits();
+        if (r < p)
+            return child;
+    }
+    return nullptr;
+}
+
+template <typename Draw>
+double run(const action_ptr& action, size_t draws, Draw draw)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < draws; k++) {
+        node_ptr child = draw(action);
+        // what the backup does to the outcome drawn
+        child->visits() += 1;
+        action->child_visited(*child, 1);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / draws;
+}
+
+int main(int argc, char** argv)
+{
+    size_t draws = (argc > 1) ? std::stoul(argv[1]) : 1000000;
+    mcts::rng::seed(42);
+
+    std::cout << "children,method,ns_per_draw" << std::endl;
+    for (size_t n : {8, 32, 128, 512, 2048}) {
+        for (std::string method : {"scan", "fenwick"}) {
+            auto root = std::make_shared<node_type>(State(), 1, 1.0);
+            auto action = root->add_action(0.0);
+            for (size_t i = 0; i < n; i++)
+                action->add_child(State(double(i)))->visits() = 1 + mcts::rng::below(100);
+
+            double ns = (method == "scan") ? run(action, draws, scan) : run(action, draws, [](const action_ptr& a) { return a->sample_child(); });
+            std::cout << n << "," << method << "," << ns << std::endl;
+        }
+    }
+
+    return 0;
+}
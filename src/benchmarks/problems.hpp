@@ -0,0 +1,143 @@
+// Problems shared by the benchmarks
+// - trap: the problem of src/benchmarks/trap.cpp (two steps, a trap between a safe and a better reward)
+// - toy: the continuous navigation of src/toy_sim.cpp
+#ifndef MCTS_BENCHMARKS_PROBLEMS_HPP
+#define MCTS_BENCHMARKS_PROBLEMS_HPP
+
+#include <cmath>
+
+#include <mcts/uct.hpp>
+
+namespace trap {
+    // the defaults of src/benchmarks/trap.cpp (single root)
+    struct Params {
+        struct uct {
+            MCTS_PARAM(double, c, 50.0);
+        };
+
+        struct spw {
+            MCTS_PARAM(double, a, 0.5);
+        };
+
+        struct cont_outcome {
+            MCTS_PARAM(double, b, 0.6);
+        };
+
+        struct mcts_node {
+            MCTS_PARAM(size_t, parallel_roots, 1);
+            MCTS_PARAM(double, virtual_loss, 100.0);
+        };
+    };
+
+    struct State {
+        double _x, _R;
+        int _time;
+
+        State(double x = 0.0, int t = 0, double R = 0.01) : _x(x), _R(R), _time(t) {}
+
+        double next_action() const
+        {
+            return random_action();
+        }
+
+        double random_action() const
+        {
+            return mcts::rng::uniform();
+        }
+
+        State move(double d) const
+        {
+            return State(_x + d + _R * mcts::rng::uniform(), _time + 1, _R);
+        }
+
+        bool terminal() const
+        {
+            return _time >= 2;
+        }
+
+        bool operator==(const State& other) const
+        {
+            double dx = _x - other._x;
+            return (dx * dx) < 1e-6;
+        }
+    };
+
+    struct Reward {
+        double operator()(const State&, double, const State& to) const
+        {
+            if (to._x < 1.0)
+                return 70.0;
+            if (to._x < 1.7)
+                return 0.0;
+            return 100.0;
+        }
+    };
+} // namespace trap
+
+namespace toy {
+    struct State {
+        double _x, _y;
+
+        State(double x = 0.0, double y = 0.0) : _x(x), _y(y) {}
+
+        double next_action() const
+        {
+            return _wrap(mcts::rng::gaussian(best_action(), 0.3));
+        }
+
+        double random_action() const
+        {
+            return mcts::rng::uniform(-M_PI, M_PI);
+        }
+
+        double best_action() const
+        {
+            return _wrap(std::atan2(2.0 - _y, 2.0 - _x));
+        }
+
+        State move(double theta) const
+        {
+            if (mcts::rng::uniform() < 0.2)
+                theta = _wrap(theta + 0.1);
+            return State(_x + 0.1 * std::cos(theta), _y + 0.1 * std::sin(theta));
+        }
+
+        bool terminal() const
+        {
+            double dx = _x - 2.0, dy = _y - 2.0;
+            return (dx * dx + dy * dy) < 0.01;
+        }
+
+        bool operator==(const State& other) const
+        {
+            double dx = _x - other._x, dy = _y - other._y;
+            return (dx * dx + dy * dy) < 1e-6;
+        }
+
+        static double _wrap(double th)
+        {
+            if (th > M_PI)
+                th -= 2 * M_PI;
+            if (th < -M_PI)
+                th += 2 * M_PI;
+            return th;
+        }
+    };
+
+    struct Reward {
+        double operator()(const State&, double, const State& to) const
+        {
+            return to.terminal() ? 10.0 : -1.0;
+        }
+    };
+
+    // heads to the goal
+    struct Policy {
+        double operator()(const State& state) const
+        {
+            return state.best_action();
+        }
+    };
+} // namespace toy
+
+#endif
@@ -0,0 +1,549 @@
+// Throughput benchmark suite
+// - domains: trap, grid world, toy_sim, a random walk with transpositions and synthetic wide/deep trees
+// - modes: sequential and tree reuse (shared and arena storage), root, tree and leaf parallelization
+//   (tree reuse plays up to 10 moves: `steps` is the number of searches run, `nodes` the nodes they created)
+// - metrics: iterations/s, rollouts/s, nodes/s and peak resident memory, for several thread counts
+// - fixed seeds: two runs of the same build search the same trees (single-threaded modes)
+//
+// usage: suite [--format csv|json] [--output file] [--threads 1,2,4] [--scale x] [--seed n] [--domain name]
+//        [--a x] [--b x] (progressive widening of the actions and of the continuous outcomes)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <mcts/uct.hpp>
+
+#include "problems.hpp"
+
+struct Params {
+    struct uct {
+        MCTS_DYN_PARAM(double, c);
+    };
+
+    struct spw {
+        MCTS_DYN_PARAM(double, a);
+    };
+
+    struct cont_outcome {
+        MCTS_DYN_PARAM(double, b);
+    };
+
+    struct mcts_node {
+        MCTS_DYN_PARAM(size_t, parallel_roots);
+        MCTS_DYN_PARAM(double, virtual_loss);
+    };
+
+    struct transposition {
+        MCTS_PARAM(size_t, size, 1 << 16);
+    };
+};
+
+MCTS_DECLARE_DYN_PARAM(double, Params::uct, c);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::spw, a, 0.5);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::cont_outcome, b, 0.6);
+MCTS_DECLARE_DYN_PARAM(size_t, Params::mcts_node, parallel_roots);
+MCTS_DECLARE_DYN_PARAM(double, Params::mcts_node, virtual_loss);
+
+// limits the number of worker threads for its lifetime
+struct ThreadLimit {
+    ThreadLimit(size_t threads)
+    {
+        mcts::par::ExecutionConfig config;
+        config.threads = threads;
+        mcts::par::configure(config);
+    }
+
+    ~ThreadLimit()
+    {
+        mcts::par::configure(mcts::par::ExecutionConfig());
+    }
+};
+
+// trap problem (src/benchmarks/trap.cpp)
+namespace trap {
+    struct Domain {
+        using state_type = State;
+        using action_type = double;
+        using reward_type = Reward;
+        using policy_type = mcts::UniformRandomPolicy<State, double>;
+        using select_type = mcts::SPWSelectPolicy<Params>;
+        using outcome_type = mcts::ContinuousOutcomeSelect<Params>;
+
+        static const char* name() { return "trap"; }
+        static State init() { return State(); }
+        static size_t rollout_depth() { return 2; }
+        static double gamma() { return 1.0; }
+        static double c() { return 50.0; }
+        static double max_reward() { return 100.0; }
+        static size_t iterations() { return 200000; }
+    };
+} // namespace trap
+
+// grid world (src/uct.cpp): reach the opposite corner, actions slip with probability 0.1
+namespace grid {
+    struct State {
+        int _x, _y, _N;
+
+        State(int x = 0, int y = 0, int N = 20) : _x(x), _y(y), _N(N) {}
+
+        bool valid(size_t action) const
+        {
+            return !((action == 0 && _y + 1 >= _N) || (action == 1 && _y == 0) || (action == 2 && _x + 1 >= _N) || (action == 3 && _x == 0));
+        }
+
+        size_t next_action() const
+        {
+            return random_action();
+        }
+
+        size_t random_action() const
+        {
+            size_t action;
+            do {
+                action = mcts::rng::below(4);
+            } while (!valid(action));
+            return action;
+        }
+
+        State move(size_t action) const
+        {
+            if (mcts::rng::uniform() < 0.1)
+                action = (action + 1) % 4;
+            int dx[] = {0, 0, 1, -1}, dy[] = {1, -1, 0, 0};
+            int x = std::min(std::max(_x + dx[action], 0), _N - 1);
+            int y = std::min(std::max(_y + dy[action], 0), _N - 1);
+            return State(x, y, _N);
+        }
+
+        bool terminal() const
+        {
+            return _x == _N - 1 && _y == _N - 1;
+        }
+
+        bool operator==(const State& other) const
+        {
+            return _x == other._x && _y == other._y;
+        }
+    };
+
+    struct Reward {
+        double operator()(const State&, size_t, const State& to) const
+        {
+            return to.terminal() ? 1.0 : 0.0;
+        }
+    };
+
+    struct Domain {
+        using state_type = State;
+        using action_type = size_t;
+        using reward_type = Reward;
+        using policy_type = mcts::UniformRandomPolicy<State, size_t>;
+        using select_type = mcts::SimpleSelectPolicy;
+        using outcome_type = mcts::SimpleOutcomeSelect;
+
+        static const char* name() { return "grid"; }
+        static State init() { return State(); }
+        static size_t rollout_depth() { return 100; }
+        static double gamma() { return 0.95; }
+        static double c() { return 10.0; }
+        static double max_reward() { return 1.0; }
+        static size_t iterations() { return 50000; }
+    };
+} // namespace grid
+
+// continuous navigation (src/toy_sim.cpp)
+namespace toy {
+    struct Domain {
+        using state_type = State;
+        using action_type = double;
+        using reward_type = Reward;
+        using policy_type = Policy;
+        using select_type = mcts::SPWSelectPolicy<Params>;
+        using outcome_type = mcts::ContinuousOutcomeSelect<Params>;
+
+        static const char* name() { return "toy_sim"; }
+        static State init() { return State(); }
+        static size_t rollout_depth() { return 2000; }
+        static double gamma() { return 0.9; }
+        static double c() { return 50.0; }
+        static double max_reward() { return 10.0; }
+        static size_t iterations() { return 50000; }
+    };
+} // namespace toy
+
+// 1-D random walk: steps slip with probability 0.2, so that the same position is reached along
+// many paths (transposition table)
+namespace walk {
+    struct State {
+        int _x, _time;
+
+        State(int x = 0, int t = 0) : _x(x), _time(t) {}
+
+        int next_action() const
+        {
+            return random_action();
+        }
+
+        int random_action() const
+        {
+            return mcts::rng::below(2) ? 1 : -1;
+        }
+
+        State move(int action) const
+        {
+            return State((mcts::rng::uniform() < 0.2) ? _x : _x + action, _time + 1);
+        }
+
+        bool terminal() const
+        {
+            return _time >= 50;
+        }
+
+        bool operator==(const State& other) const
+        {
+            return _x == other._x && _time == other._time;
+        }
+    };
+
+    struct Reward {
+        double operator()(const State&, int, const State& to) const
+        {
+            return (to._x >= 10) ? 1.0 : 0.0;
+        }
+    };
+
+    struct Domain {
+        using state_type = State;
+        using action_type = int;
+        using reward_type = Reward;
+        using policy_type = mcts::UniformRandomPolicy<State, int>;
+        using select_type = mcts::SimpleSelectPolicy;
+        using outcome_type = mcts::TranspositionOutcomeSelect<Params>;
+
+        static const char* name() { return "walk"; }
+        static State init() { return State(); }
+        static size_t rollout_depth() { return 50; }
+        static double gamma() { return 0.95; }
+        static double c() { return 1.0; }
+        static double max_reward() { return 1.0; }
+        static size_t iterations() { return 50000; }
+    };
+} // namespace walk
+
+namespace mcts {
+    template <>
+    struct child_hash<walk::State> {
+        static size_t hash(const walk::State& state)
+        {
+            return size_t(state._x) * 64 + state._time;
+        }
+    };
+} // namespace mcts
+
+// synthetic trees: `Width` actions per state, terminal after `Depth` steps,
+// deterministic transitions and a reward that depends on the action only
+namespace synthetic {
+    template <size_t Width, size_t Depth>
+    struct State {
+        size_t _depth, _id;
+
+        State(size_t depth = 0, size_t id = 0) : _depth(depth), _id(id) {}
+
+        size_t next_action() const
+        {
+            return random_action();
+        }
+
+        size_t random_action() const
+        {
+            return mcts::rng::below(Width);
+        }
+
+        State move(size_t action) const
+        {
+            return State(_depth + 1, _id * Width + action + 1);
+        }
+
+        bool terminal() const
+        {
+            return _depth >= Depth;
+        }
+
+        bool operator==(const State& other) const
+        {
+            return _depth == other._depth && _id == other._id;
+        }
+    };
+
+    template <size_t Width, size_t Depth>
+    struct Reward {
+        double operator()(const State<Width, Depth>&, size_t action, const State<Width, Depth>&) const
+        {
+            return double(action % 7) / 7.0;
+        }
+    };
+
+    template <size_t Width, size_t Depth, typename Select>
+    struct Domain {
+        using state_type = State<Width, Depth>;
+        using action_type = size_t;
+        using reward_type = Reward<Width, Depth>;
+        using policy_type = mcts::UniformRandomPolicy<state_type, size_t>;
+        using select_type = Select;
+        using outcome_type = mcts::SimpleOutcomeSelect;
+
+        static state_type init() { return state_type(); }
+        static size_t rollout_depth() { return Depth; }
+        static double gamma() { return 1.0; }
+        static double c() { return 1.0; }
+        static double max_reward() { return 1.0; }
+        static size_t iterations() { return 100000; }
+    };
+
+    struct Wide : Domain<256, 4, mcts::SPWSelectPolicy<Params>> {
+        static const char* name() { return "wide"; }
+    };
+
+    struct Deep : Domain<3, 200, mcts::SimpleSelectPolicy> {
+        static const char* name() { return "deep"; }
+    };
+} // namespace synthetic
+
+struct Result {
+    std::string domain, mode, storage;
+    size_t threads, roots, steps, iterations, rollouts, nodes;
+    double seconds;
+    long peak_rss_kb;
+};
+
+// peak resident set size since the last reset_peak_memory() (or since the start)
+void reset_peak_memory()
+{
+    std::ofstream clear("/proc/self/clear_refs");
+    if (clear)
+        clear << "5";
+}
+
+long peak_memory_kb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stol(line.substr(6));
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct Options {
+    std::string format = "csv", output, domain;
+    std::vector<size_t> threads;
+    double scale = 1.0;
+    uint64_t seed = 42;
+};
+
+enum class Mode {
+    sequential,
+    reroot,
+    root_parallel,
+    tree_parallel,
+    leaf_parallel
+};
+
+template <typename Domain, typename Storage>
+Result run(Mode mode, size_t threads, size_t roots, const Options& options)
+{
+    using tree_type = mcts::MCTSNode<Params, typename Domain::state_type, mcts::SimpleStateInit<typename Domain::state_type>, mcts::SimpleValueInit, mcts::UCTValue<Params>, typename Domain::policy_type, typename Domain::action_type, typename Domain::select_type, typename Domain::outcome_type, Storage>;
+    const size_t leaf_rollouts = 8;
+    const size_t reroot_steps = 10;
+
+    Params::uct::set_c(Domain::c());
+    Params::mcts_node::set_parallel_roots(mode == Mode::root_parallel ? roots : 1);
+    // a virtual loss is worth the largest reward
+    Params::mcts_node::set_virtual_loss(Domain::max_reward());
+
+    size_t iterations = std::max(size_t(1), static_cast<size_t>(Domain::iterations() * options.scale));
+    typename Domain::reward_type reward;
+
+    ThreadLimit limit(threads);
+    mcts::rng::seed(options.seed);
+    reset_peak_memory();
+
+    Result result;
+    result.domain = Domain::name();
+    result.storage = Storage::reference_counted ? "shared" : "arena";
+    result.threads = threads;
+    result.roots = Params::mcts_node::parallel_roots();
+    result.rollouts = iterations;
+    result.steps = 1;
+    result.nodes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    auto tree = std::make_shared<tree_type>(Domain::init(), Domain::rollout_depth(), Domain::gamma());
+    switch (mode) {
+    case Mode::sequential:
+        result.mode = "sequential";
+        result.iterations = tree->compute(reward, mcts::IterationBudget(iterations));
+        break;
+    case Mode::reroot:
+        result.mode = "reroot";
+        // play the best action and keep searching from the outcome observed (a fresh tree if it was never expanded)
+        // (the nodes kept from the previous step are not counted again)
+        result.iterations = 0;
+        result.steps = 0;
+        for (size_t step = 0; step < reroot_steps && !tree->state()->terminal(); step++) {
+            size_t nodes = tree->usage().nodes;
+            result.iterations += tree->compute(reward, mcts::IterationBudget(iterations / reroot_steps));
+            result.nodes += tree->usage().nodes - nodes;
+            result.steps++;
+            auto best = tree->best_action();
+            if (!best)
+                break;
+            auto state = tree->state()->move(best->action());
+            auto next = tree->reroot(best->action(), state);
+            tree = next ? next : std::make_shared<tree_type>(state, Domain::rollout_depth(), Domain::gamma());
+        }
+        result.rollouts = result.iterations;
+        break;
+    case Mode::root_parallel:
+        result.mode = "root_parallel";
+        // the budget is per tree: keep the total number of iterations
+        result.iterations = tree->compute(reward, mcts::IterationBudget(iterations / roots));
+        result.rollouts = result.iterations;
+        break;
+    case Mode::tree_parallel:
+        result.mode = "tree_parallel";
+        tree->compute_shared(reward, iterations);
+        result.iterations = iterations;
+        break;
+    case Mode::leaf_parallel:
+        result.mode = "leaf_parallel";
+        result.iterations = iterations / leaf_rollouts;
+        for (size_t k = 0; k < result.iterations; k++)
+            tree->iterate(reward, leaf_rollouts);
+        result.rollouts = result.iterations * leaf_rollouts;
+        break;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (mode != Mode::reroot)
+        result.nodes = tree->usage().nodes;
+    result.peak_rss_kb = peak_memory_kb();
+
+    return result;
+}
+
+template <typename Domain>
+void run_domain(const Options& options, std::vector<Result>& results)
+{
+    if (!options.domain.empty() && options.domain != Domain::name())
+        return;
+
+    results.push_back(run<Domain, mcts::SharedStorage>(Mode::sequential, 1, 1, options));
+    results.push_back(run<Domain, mcts::ArenaStorage>(Mode::sequential, 1, 1, options));
+    results.push_back(run<Domain, mcts::SharedStorage>(Mode::reroot, 1, 1, options));
+    results.push_back(run<Domain, mcts::ArenaStorage>(Mode::reroot, 1, 1, options));
+    for (size_t threads : options.threads) {
+        for (size_t roots : {size_t(2), size_t(4)})
+            results.push_back(run<Domain, mcts::SharedStorage>(Mode::root_parallel, threads, roots, options));
+        results.push_back(run<Domain, mcts::SharedStorage>(Mode::tree_parallel, threads, 1, options));
+        results.push_back(run<Domain, mcts::SharedStorage>(Mode::leaf_parallel, threads, 1, options));
+    }
+    std::cerr << Domain::name() << " done" << std::endl;
+}
+
+double rate(size_t count, double seconds)
+{
+    return (seconds > 0.0) ? count / seconds : 0.0;
+}
+
+void write_csv(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "domain,mode,storage,threads,roots,steps,iterations,rollouts,nodes,seconds,iterations_per_sec,rollouts_per_sec,nodes_per_sec,peak_rss_kb\n";
+    for (const Result& r : results) {
+        out << r.domain << "," << r.mode << "," << r.storage << "," << r.threads << "," << r.roots << "," << r.steps << "," << r.iterations << "," << r.rollouts << "," << r.nodes << ","
+            << r.seconds << "," << rate(r.iterations, r.seconds) << "," << rate(r.rollouts, r.seconds) << "," << rate(r.nodes, r.seconds) << "," << r.peak_rss_kb << "\n";
+    }
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "  {\"domain\": \"" << r.domain << "\", \"mode\": \"" << r.mode << "\", \"storage\": \"" << r.storage << "\", \"threads\": " << r.threads << ", \"roots\": " << r.roots
+            << ", \"steps\": " << r.steps << ", \"iterations\": " << r.iterations << ", \"rollouts\": " << r.rollouts << ", \"nodes\": " << r.nodes << ", \"seconds\": " << r.seconds
+            << ", \"iterations_per_sec\": " << rate(r.iterations, r.seconds) << ", \"rollouts_per_sec\": " << rate(r.rollouts, r.seconds) << ", \"nodes_per_sec\": " << rate(r.nodes, r.seconds)
+            << ", \"peak_rss_kb\": " << r.peak_rss_kb << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--format")
+            options.format = value;
+        else if (arg == "--output")
+            options.output = value;
+        else if (arg == "--scale")
+            options.scale = std::stod(value);
+        else if (arg == "--seed")
+            options.seed = std::stoull(value);
+        else if (arg == "--domain")
+            options.domain = value;
+        else if (arg == "--a")
+            Params::spw::set_a(std::stod(value));
+        else if (arg == "--b")
+            Params::cont_outcome::set_b(std::stod(value));
+        else if (arg == "--threads") {
+            std::stringstream list(value);
+            std::string item;
+            while (std::getline(list, item, ','))
+                options.threads.push_back(std::stoul(item));
+        }
+        else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.threads.empty()) {
+        size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t t = 1; t < hardware; t *= 2)
+            options.threads.push_back(t);
+        options.threads.push_back(hardware);
+    }
+
+    std::vector<Result> results;
+    run_domain<trap::Domain>(options, results);
+    run_domain<grid::Domain>(options, results);
+    run_domain<toy::Domain>(options, results);
+    run_domain<walk::Domain>(options, results);
+    run_domain<synthetic::Wide>(options, results);
+    run_domain<synthetic::Deep>(options, results);
+
+    std::ofstream file;
+    if (!options.output.empty())
+        file.open(options.output);
+    std::ostream& out = options.output.empty() ? std::cout : file;
+
+    if (options.format == "json")
+        write_json(out, results);
+    else
+        write_csv(out, results);
+
+    return 0;
+}
@@ -1,29 +1,51 @@
 #include <iostream>
 #include <ctime>
+#include <string>
 #include <mcts/uct.hpp>
+#ifdef SNAPSHOT
+#include <mcts/serialize.hpp>
+#endif
+#ifdef DISTRIBUTED
+#include <mcts/distributed.hpp>
+#endif
 
+// defaults, overridden from the command line: trap [--c x] [--a x] [--b x] [--roots n] [--iterations n]
+// (--roots 4 --iterations 18000 runs root-parallel with the budget of the former parallel targets)
 struct Params {
     struct uct {
-        MCTS_PARAM(double, c, 50.0);
+        MCTS_DYN_PARAM(double, c);
     };
 
     struct spw {
-        MCTS_PARAM(double, a, 0.5);
+        MCTS_DYN_PARAM(double, a);
     };
 
     struct cont_outcome {
-        MCTS_PARAM(double, b, 0.6);
+        MCTS_DYN_PARAM(double, b);
     };
 
     struct mcts_node {
-#ifdef SINGLE
-        MCTS_PARAM(size_t, parallel_roots, 1);
-#else
-        MCTS_PARAM(size_t, parallel_roots, 4);
+        MCTS_DYN_PARAM(size_t, parallel_roots);
+        MCTS_DYN_PARAM(double, virtual_loss);
+#ifdef STATS
+        MCTS_PARAM(bool, stats, true);
 #endif
     };
 };
 
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::uct, c, 50.0);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::spw, a, 0.5);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::cont_outcome, b, 0.6);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(size_t, Params::mcts_node, parallel_roots, 1);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::mcts_node, virtual_loss, 100.0);
+
+// continuous actions: look children up by hash instead of scanning them
+namespace mcts {
+    template <>
+    struct child_hash<double> : std_child_hash<double> {
+    };
+} // namespace mcts
+
 namespace global {
     double a = 70;
     double h = 100;
@@ -57,12 +79,12 @@ struct SimpleState {
 
     double random_action() const
     {
-        return (std::rand() / double(RAND_MAX));
+        return mcts::rng::uniform();
     }
 
     SimpleState move(double d) const
     {
-        double x_new = _x + d + _R * (std::rand() / double(RAND_MAX));
+        double x_new = _x + d + _R * mcts::rng::uniform();
         return SimpleState(x_new, _time + 1, _R);
     }
 
@@ -78,6 +100,28 @@ struct SimpleState {
     }
 };
 
+#if defined(SNAPSHOT) || defined(DISTRIBUTED)
+namespace mcts {
+    template <>
+    struct serializer<SimpleState> {
+        static void write(BinaryWriter& out, const SimpleState& state)
+        {
+            out.write(state._x);
+            out.write(state._R);
+            out.write(state._time);
+        }
+
+        static SimpleState read(BinaryReader& in)
+        {
+            double x = in.read<double>();
+            double R = in.read<double>();
+            int time = in.read<int>();
+            return SimpleState(x, time, R);
+        }
+    };
+} // namespace mcts
+#endif
+
 struct RewardFunction {
     template <typename State>
     double operator()(std::shared_ptr<State> from_state, double action, std::shared_ptr<State> to_state)
@@ -93,32 +137,87 @@ struct RewardFunction {
     }
 };
 
-int main()
+int main(int argc, char** argv)
 {
-    std::srand(std::time(0));
+    // per tree (each of the parallel roots searches as many)
+    size_t n_iter = 50000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--c")
+            Params::uct::set_c(std::stod(value));
+        else if (arg == "--a")
+            Params::spw::set_a(std::stod(value));
+        else if (arg == "--b")
+            Params::cont_outcome::set_b(std::stod(value));
+        else if (arg == "--roots")
+            Params::mcts_node::set_parallel_roots(std::stoul(value));
+        else if (arg == "--iterations")
+            n_iter = std::stoul(value);
+        else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    mcts::rng::seed(std::time(0));
+#ifdef DISTRIBUTED
+    // 4 worker processes, started before the execution context
+    mcts::ForkTransport transport(4);
+#endif
     mcts::par::init();
 
     RewardFunction world;
     SimpleState init;
 
-#ifdef SIMPLE
-    auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::SimpleOutcomeSelect>>(init, 2, 1.0);
+#ifdef ARENA
+    using Storage = mcts::ArenaStorage;
 #else
-    auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>>(init, 2, 1.0);
+    using Storage = mcts::SharedStorage;
 #endif
 
-#ifdef SINGLE
-    const int n_iter = 50000;
+#ifdef SIMPLE
+    auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::SimpleOutcomeSelect, Storage>>(init, 2, 1.0);
 #else
-    const int n_iter = 18000;
+    auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>, Storage>>(init, 2, 1.0);
 #endif
 
     auto t1 = std::chrono::steady_clock::now();
 
+#if defined(SHARED_TREE)
+    tree->compute_shared(world, n_iter);
+#elif defined(DISTRIBUTED)
+    // one worker per process, each with a quarter of the iterations (and a minute at most)
+    mcts::compute_distributed(*tree, transport, 4, world, mcts::stop_any(mcts::IterationBudget(n_iter / 4), mcts::TimeBudget(std::chrono::seconds(60))));
+#else
     tree->compute(world, n_iter);
+#endif
 
     auto time_running = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
     std::cout << "Time in sec: " << time_running / 1000.0 << std::endl;
+#ifdef STATS
+    tree->stats().write_text(std::cout);
+    // the same tree walked: parallel reductions and the expected line of play
+    std::cout << "walked nodes: " << mcts::visit::node_count(*tree, true) << ", bytes: " << mcts::visit::memory_footprint(*tree, true) << ", levels:";
+    for (size_t count : mcts::visit::depth_histogram(*tree, true))
+        std::cout << " " << count;
+    std::cout << std::endl;
+    for (const auto& step : mcts::visit::principal_variation(*tree))
+        std::cout << "pv: " << step.action << " (" << step.node->visits() << " visits)" << std::endl;
+#endif
+
+#ifdef SNAPSHOT
+    {
+        // save the tree, map it back and search on from the materialized copy
+        mcts::save_tree(*tree, "trap_tree.bin");
+        auto t2 = std::chrono::steady_clock::now();
+        mcts::TreeSnapshot<decltype(tree)::element_type> snapshot("trap_tree.bin");
+        auto root = snapshot.root();
+        auto open_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t2).count();
+        std::cout << "Snapshot: " << snapshot.nodes() << " nodes, " << snapshot.actions() << " actions, opened in " << open_time << " us, root visits " << root.visits() << std::endl;
+        tree = snapshot.materialize();
+        std::cout << "Materialized: " << tree->usage().nodes << " nodes" << std::endl;
+    }
+#endif
 
     auto best = tree->best_action();
     if (best != nullptr) {
@@ -127,11 +226,18 @@ int main()
         auto new_state = init.move(best->action());
         std::cout << "Moving to: " << new_state._x << std::endl;
 
-        // tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>>(new_state, 2);
-        //
-        // best = tree->best_action();
-        // if (best != nullptr)
-        //     std::cout << best->action() << std::endl;
+        // reuse the statistics gathered below the observed outcome (if it was explored)
+        auto next = tree->reroot(best->action(), new_state, true);
+        if (next != nullptr)
+            std::cout << "Reusing " << next->visits() << " visits" << std::endl;
+        else
+            next = std::make_shared<decltype(tree)::element_type>(new_state, 2, 1.0);
+        tree = next;
+        tree->compute(world, n_iter / 10);
+
+        best = tree->best_action();
+        if (best != nullptr)
+            std::cout << best->action() << std::endl;
     }
 
     return 0;
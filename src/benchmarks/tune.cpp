@@ -0,0 +1,100 @@
+// Hyperparameter tuning on the trap problem (src/benchmarks/trap.cpp)
+// - tunes uct::c, spw::a and cont_outcome::b for the best decision quality per millisecond
+// - a decision is right when the first step stays before the trap and lets the second one jump over it
+// - trials run in child processes (ForkTransport), one per hardware thread by default
+//
+// usage: tune [--iterations n] [--rounds n] [--candidates n] [--repeats n] [--workers n] [--seed n]
+
+#include <iostream>
+#include <string>
+
+#include <mcts/uct.hpp>
+#include <mcts/distributed.hpp>
+#include <mcts/tuning.hpp>
+
+#include "problems.hpp"
+
+struct Params {
+    struct uct {
+        MCTS_DYN_PARAM(double, c);
+    };
+
+    struct spw {
+        MCTS_DYN_PARAM(double, a);
+    };
+
+    struct cont_outcome {
+        MCTS_DYN_PARAM(double, b);
+    };
+
+    struct mcts_node {
+        // trials are sequential: they run side by side on the cores
+        MCTS_PARAM(size_t, parallel_roots, 1);
+    };
+};
+
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::uct, c, 50.0);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::spw, a, 0.5);
+MCTS_DECLARE_DYN_PARAM_DEFAULT(double, Params::cont_outcome, b, 0.6);
+
+int main(int argc, char** argv)
+{
+#ifdef MCTS_HAS_FORK
+    size_t iterations = 5000;
+    mcts::TuneOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--iterations")
+            iterations = std::stoul(value);
+        else if (arg == "--rounds")
+            options.rounds = std::stoul(value);
+        else if (arg == "--candidates")
+            options.candidates = std::stoul(value);
+        else if (arg == "--repeats")
+            options.repeats = std::stoul(value);
+        else if (arg == "--workers")
+            options.workers = std::stoul(value);
+        else if (arg == "--seed")
+            options.seed = std::stoull(value);
+        else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // the trials run in these processes: started before anything uses threads
+    mcts::ForkTransport transport(options.workers);
+
+    std::vector<mcts::TunedParam> params = {
+        {"uct::c", 1.0, 200.0, true, false, Params::uct::set_c},
+        {"spw::a", 0.1, 0.9, false, false, Params::spw::set_a},
+        {"cont_outcome::b", 0.1, 0.9, false, false, Params::cont_outcome::set_b}};
+
+    // copied to the workers: capture by value
+    auto trial = [iterations]() {
+        using tree_type = mcts::MCTSNode<Params, trap::State, mcts::SimpleStateInit<trap::State>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<trap::State, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>;
+        auto tree = std::make_shared<tree_type>(trap::State(), 2, 1.0);
+        tree->compute(trap::Reward(), iterations);
+        auto best = tree->best_action();
+        // 70 now and 100 at the next step
+        return (best != nullptr && best->action() > 0.7 && best->action() < 0.99) ? 1.0 : 0.0;
+    };
+
+    std::vector<mcts::TuneResult> results = mcts::tune(params, trial, transport, options);
+
+    std::cout << "score,quality,ms";
+    for (const auto& p : params)
+        std::cout << "," << p.name;
+    std::cout << std::endl;
+    for (size_t i = 0; i < std::min(results.size(), size_t(10)); i++) {
+        std::cout << results[i].score() << "," << results[i].quality << "," << results[i].ms;
+        for (double v : results[i].values)
+            std::cout << "," << v;
+        std::cout << std::endl;
+    }
+#else
+    std::cerr << "tune: needs fork()" << std::endl;
+#endif
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+// IncrementalMeanBackup against MeanBackup
+// - the same returns (single, batched, with virtual losses) give the same sums from the running means
+// - searches seeded alike pick the same best action with the same mean value
+// - a shared-tree search keeps the visits of the actions in line with the root
+// - the deprecated writable accessors still update SumStatistics actions, and mean statistics have none
+//
+// usage: backup (exit status 1 on failure)
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <mcts/uct.hpp>
+
+struct Params {
+    struct uct {
+        MCTS_PARAM(double, c, 1.0);
+    };
+
+    struct mcts_node {
+        MCTS_PARAM(size_t, parallel_roots, 1);
+        MCTS_PARAM(double, virtual_loss, 1.0);
+    };
+};
+
+// 1-D walk: reach x = 4 within 12 steps
+struct State {
+    int _x, _time;
+
+    State(int x = 0, int t = 0) : _x(x), _time(t) {}
+
+    int next_action() const
+    {
+        return random_action();
+    }
+
+    int random_action() const
+    {
+        return int(mcts::rng::below(3)) - 1;
+    }
+
+    State move(int action) const
+    {
+        return State(_x + action, _time + 1);
+    }
+
+    bool terminal() const
+    {
+        return _time >= 12 || _x >= 4;
+    }
+
+    bool operator==(const State& other) const
+    {
+        return _x == other._x && _time == other._time;
+    }
+};
+
+struct Reward {
+    double operator()(const State&, int, const State& to) const
+    {
+        return (to._x >= 4) ? 1.0 : -0.01;
+    }
+};
+
+template <typename Backup>
+using tree_type = mcts::MCTSNode<Params, State, mcts::SimpleStateInit<State>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::UniformRandomPolicy<State, int>, int, mcts::SimpleSelectPolicy, mcts::SimpleOutcomeSelect, mcts::SharedStorage, Backup>;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+bool close(double a, double b, double tolerance)
+{
+    return std::abs(a - b) <= tolerance * std::max(1.0, std::max(std::abs(a), std::abs(b)));
+}
+
+template <typename Backup>
+void same_returns(double tolerance, const std::string& name)
+{
+    auto sums = std::make_shared<tree_type<mcts::MeanBackup>>(State(), 12, 0.9);
+    auto means = std::make_shared<tree_type<Backup>>(State(), 12, 0.9);
+    auto a = sums->add_action(1);
+    auto b = means->add_action(1);
+
+    mcts::rng::Xoshiro256 generator(42);
+    for (size_t i = 0; i < 100000; i++) {
+        double r = 100.0 * generator.uniform() - 30.0;
+        switch (i % 3) {
+        case 0:
+            a->update_stats(r);
+            b->update_stats(r);
+            break;
+        case 1:
+            // batch of 4 returns
+            a->update_stats(4.0 * r, 4.0 * r * r + 1.0, 4);
+            b->update_stats(4.0 * r, 4.0 * r * r + 1.0, 4);
+            break;
+        default:
+            a->add_virtual_loss(1.0);
+            b->add_virtual_loss(1.0);
+            a->revert_virtual_loss(2.0 * r, 2.0 * r * r, 2, 1.0);
+            b->revert_virtual_loss(2.0 * r, 2.0 * r * r, 2, 1.0);
+        }
+    }
+
+    check(a->visits() == b->visits(), name + ": visits");
+    check(close(a->value(), b->value(), tolerance), name + ": value " + std::to_string(a->value()) + " / " + std::to_string(b->value()));
+    check(close(a->squared_value(), b->squared_value(), tolerance), name + ": squared value");
+    check(close(a->variance(), b->variance(), tolerance), name + ": variance");
+}
+
+void same_search()
+{
+    mcts::rng::seed(7);
+    auto sums = std::make_shared<tree_type<mcts::MeanBackup>>(State(), 12, 0.9);
+    sums->compute(Reward(), 20000);
+
+    mcts::rng::seed(7);
+    auto means = std::make_shared<tree_type<mcts::IncrementalMeanBackup<>>>(State(), 12, 0.9);
+    means->compute(Reward(), 20000);
+
+    auto a = sums->best_action();
+    auto b = means->best_action();
+    check(a && b && a->action() == b->action(), "search: best action");
+    if (a && b)
+        check(close(a->value() / a->visits(), b->value() / b->visits(), 1e-2), "search: mean value of the best action");
+}
+
+void shared_search()
+{
+    auto tree = std::make_shared<tree_type<mcts::IncrementalMeanBackup<float>>>(State(), 12, 0.9);
+    tree->compute_shared(Reward(), 20000);
+
+    size_t visits = 0;
+    for (const auto& action : tree->children()) {
+        visits += action->visits();
+        check(action->visits() == 0 || std::abs(action->value() / action->visits()) <= 1.0 + 1e-4, "shared search: mean in the range of the returns");
+    }
+    check(visits == tree->visits(), "shared search: visits " + std::to_string(visits) + " / " + std::to_string(tree->visits()));
+}
+
+template <typename Action, typename = void>
+struct writable_value : std::false_type {
+};
+
+template <typename Action>
+struct writable_value<Action, decltype(void(std::declval<Action&>().value() += 1.0))> : std::true_type {
+};
+
+static_assert(!writable_value<tree_type<mcts::IncrementalMeanBackup<>>::action_type>::value, "mean statistics are only updated through update_stats()");
+
+void writable_sums()
+{
+    auto tree = std::make_shared<tree_type<mcts::MeanBackup>>(State(), 12, 0.9);
+    auto a = tree->add_action(1);
+    auto b = tree->add_action(-1);
+    a->update_stats(2.0);
+    a->update_stats(3.0);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    b->value() += 2.0;
+    b->value() += 3.0;
+    b->squared_value() += 13.0;
+    b->visits() += 2;
+#pragma GCC diagnostic pop
+
+    check(a->visits() == b->visits(), "writable accessors: visits");
+    check(a->value() == b->value(), "writable accessors: value");
+    check(a->squared_value() == b->squared_value(), "writable accessors: squared value");
+}
+
+int main()
+{
+    same_returns<mcts::IncrementalMeanBackup<>>(1e-9, "double");
+    same_returns<mcts::IncrementalMeanBackup<float>>(1e-4, "float");
+    same_search();
+    shared_search();
+    writable_sums();
+
+    if (failures > 0)
+        return 1;
+    std::cout << "backup: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+// TranspositionTable under concurrent inserts
+// - 1000 entries (500 buckets, not a multiple of the lock stripes)
+// - at most two keys per bucket: nothing is ever evicted, so every key must be created exactly once
+//   and every thread must get back the same node for it
+//
+// usage: transposition (exit status 1 on failure)
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <mcts/transposition.hpp>
+
+struct Key {
+    size_t _id;
+
+    bool operator==(const Key& other) const
+    {
+        return _id == other._id;
+    }
+};
+
+namespace mcts {
+    template <>
+    struct child_hash<Key> {
+        static size_t hash(const Key& key)
+        {
+            return key._id * size_t(0x9e3779b97f4a7c15ULL);
+        }
+    };
+} // namespace mcts
+
+// the part of MCTSNode used by the table
+struct Node {
+    using state_type = Key;
+    using storage_type = mcts::SharedStorage;
+
+    Node(const Key& key, size_t depth) : _state(std::make_shared<Key>(key)), _depth(depth) {}
+
+    std::shared_ptr<Key> state() const
+    {
+        return _state;
+    }
+
+    size_t depth() const
+    {
+        return _depth;
+    }
+
+    size_t visits() const
+    {
+        return 0;
+    }
+
+    std::shared_ptr<Key> _state;
+    size_t _depth;
+};
+
+struct Table : public mcts::TranspositionTable<Node> {
+    using mcts::TranspositionTable<Node>::TranspositionTable;
+
+    size_t bucket(const Key& key, size_t depth) const
+    {
+        return _hash(key, depth) % _buckets.size();
+    }
+};
+
+int main()
+{
+    const size_t size = 1000;
+    const size_t depth = 3;
+    const size_t threads = 8;
+    const size_t rounds = 200;
+
+    Table table(size);
+    const size_t buckets = table.capacity() / 2;
+
+    // fill every bucket with two keys
+    std::vector<Key> keys;
+    std::vector<size_t> load(buckets, 0);
+    for (size_t id = 0; keys.size() < table.capacity(); id++) {
+        Key key{id};
+        size_t b = table.bucket(key, depth);
+        if (load[b] < 2) {
+            load[b]++;
+            keys.push_back(key);
+        }
+    }
+
+    std::atomic<size_t> created(0);
+    std::vector<std::vector<std::shared_ptr<Node>>> found(threads, std::vector<std::shared_ptr<Node>>(keys.size()));
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (size_t r = 0; r < rounds; r++) {
+                // every thread walks the keys from a different place
+                for (size_t i = 0; i < keys.size(); i++) {
+                    size_t k = (i + t * keys.size() / threads) % keys.size();
+                    auto node = table.find_or_insert(keys[k], depth, [&]() {
+                        created++;
+                        // let the other threads run while the bucket is being filled
+                        std::this_thread::yield();
+                        return std::make_shared<Node>(keys[k], depth);
+                    });
+                    if (!found[t][k])
+                        found[t][k] = node;
+                    else if (found[t][k] != node) {
+                        std::cerr << "key " << keys[k]._id << ": node replaced" << std::endl;
+                        std::exit(1);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    if (created != keys.size()) {
+        std::cerr << created << " nodes created for " << keys.size() << " keys" << std::endl;
+        return 1;
+    }
+    for (size_t k = 0; k < keys.size(); k++) {
+        for (size_t t = 1; t < threads; t++) {
+            if (found[t][k] != found[0][k]) {
+                std::cerr << "key " << keys[k]._id << ": threads got different nodes" << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "transposition: " << keys.size() << " keys, " << threads << " threads: ok" << std::endl;
+    return 0;
+}
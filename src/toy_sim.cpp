@@ -1,18 +1,13 @@
+#include <algorithm>
 #include <ctime>
 #include <iostream>
-#include <random>
 
 #include <mcts/uct.hpp>
 
 template <typename T>
 inline T gaussian_rand(T m = 0.0, T v = 1.0)
 {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-
-    std::normal_distribution<T> gaussian(m, v);
-
-    return gaussian(gen);
+    return mcts::rng::gaussian(m, v);
 }
 
 struct Params {
@@ -69,7 +64,7 @@ struct SimpleState {
 
     double random_action() const
     {
-        return (std::rand() * 2.0 * M_PI / double(RAND_MAX) - M_PI);
+        return mcts::rng::uniform(-M_PI, M_PI);
     }
 
     double best_action() const
@@ -87,7 +82,7 @@ struct SimpleState {
         double r = 0.1;
         double th = theta;
         if (prob) {
-            double p = std::rand() / double(RAND_MAX);
+            double p = mcts::rng::uniform();
             if (p < 0.2) {
                 th += 0.1;
                 if (th > M_PI)
@@ -112,6 +107,41 @@ struct SimpleState {
         return false;
     }
 
+#ifdef BATCHED
+    // leaf rollouts step their states together: the random perturbations first,
+    // then the kinematics over plain arrays (the sin/cos loop can be vectorized)
+    static void move_batch(const SimpleState* const* from, const double* actions, SimpleState* const* to, size_t n)
+    {
+        const double r = 0.1;
+        double th[16], s[16], c[16];
+        for (size_t begin = 0; begin < n; begin += 16) {
+            size_t m = std::min(n - begin, size_t(16));
+            for (size_t i = 0; i < m; i++) {
+                th[i] = actions[begin + i];
+                if (mcts::rng::uniform() < 0.2) {
+                    th[i] += 0.1;
+                    if (th[i] > M_PI)
+                        th[i] -= 2 * M_PI;
+                }
+            }
+            for (size_t i = 0; i < m; i++) {
+                s[i] = std::sin(th[i]);
+                c[i] = std::cos(th[i]);
+            }
+            for (size_t i = 0; i < m; i++) {
+                to[begin + i]->_x = r * c[i] + from[begin + i]->_x;
+                to[begin + i]->_y = r * s[i] + from[begin + i]->_y;
+            }
+        }
+    }
+
+    static void terminal_batch(const SimpleState* const* states, bool* terminal, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            terminal[i] = states[i]->terminal();
+    }
+#endif
+
     bool operator==(const SimpleState& other) const
     {
         double dx = _x - other._x;
@@ -122,27 +152,44 @@ struct SimpleState {
 
 struct RewardFunction {
     template <typename State>
-    double operator()(std::shared_ptr<State> from_state, double action, std::shared_ptr<State> to_state)
+    double operator()(const State& from_state, double action, const State& to_state)
     {
-        if (to_state->terminal())
+        if (to_state.terminal())
             return 10.0;
         return -1.0;
     }
+
+#ifdef BATCHED
+    template <typename State>
+    void operator()(const State* const* from, const double* actions, const State* const* to, double* rewards, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            rewards[i] = (*this)(*from[i], actions[i], *to[i]);
+    }
+#endif
 };
 
 namespace mcts {
     template <typename State, typename Action>
     struct BestHeuristicPolicy {
-        Action operator()(const std::shared_ptr<State>& state)
+        Action operator()(const State& state)
         {
-            return state->best_action();
+            return state.best_action();
         }
+
+#ifdef BATCHED
+        void operator()(const State* const* states, Action* actions, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+                actions[i] = states[i]->best_action();
+        }
+#endif
     };
 } // namespace mcts
 
 int main()
 {
-    std::srand(std::time(0));
+    mcts::rng::seed(std::time(0));
     mcts::par::init();
 
     global::goal_x = 2.0;
@@ -151,19 +198,42 @@ int main()
     RewardFunction world;
     SimpleState init(0.0, 0.0);
 
-    auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::BestHeuristicPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>>>(init, 2000);
+#ifdef MAX_BACKUP
+    // nodes pass up the value of their best action instead of the sampled returns
+    using Backup = mcts::MaxBackup;
+#else
+    using Backup = mcts::MeanBackup;
+#endif
+    auto tree = std::make_shared<mcts::MCTSNode<Params, SimpleState, mcts::SimpleStateInit<SimpleState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, mcts::BestHeuristicPolicy<SimpleState, double>, double, mcts::SPWSelectPolicy<Params>, mcts::ContinuousOutcomeSelect<Params>, mcts::SharedStorage, Backup>>(init, 2000);
 #ifdef SINGLE
     const int n_iter = 400000;
 #else
     const int n_iter = 200000;
 #endif
 
+#ifdef MEMORY_BUDGET
+    // new outcome states keep coming: bound the tree, the least visited subtrees are dropped
+    mcts::MemoryBudget budget;
+    budget.max_nodes = 50000;
+    tree->set_memory_budget(budget);
+#endif
+
     auto t1 = std::chrono::steady_clock::now();
 
+#ifdef LEAF_PARALLEL
+    // leaf parallelization: 8 rollouts per tree traversal
+    for (int k = 0; k < n_iter / 8; k++)
+        tree->iterate(world, 8);
+#else
     tree->compute(world, n_iter);
+#endif
 
     auto time_running = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
     std::cout << "Time in sec: " << time_running / 1000.0 << std::endl;
+#ifdef MEMORY_BUDGET
+    // root-parallel workers grow their share of the budget, the merged tree is pruned back under it
+    std::cout << "Nodes: " << tree->usage().nodes << " (budget " << budget.max_nodes << "), actions: " << tree->usage().actions << ", bytes: " << tree->memory_usage() << std::endl;
+#endif
 
     auto best = tree->best_action();
     if (best == nullptr)
@@ -14,6 +14,10 @@ struct Params {
     struct mcts_node {
         MCTS_PARAM(size_t, parallel_roots, 1);
     };
+
+    struct transposition {
+        MCTS_PARAM(size_t, size, 1 << 16);
+    };
 };
 
 struct GridState {
@@ -75,7 +79,7 @@ struct GridState {
     {
         int x_new = _x, y_new = _y;
 
-        double r = std::rand() / (double)RAND_MAX;
+        double r = mcts::rng::uniform();
         if ((r - _prob) < 0 && prob)
             action = (action + 1) % 4;
 
@@ -113,7 +117,7 @@ struct GridState {
     {
         size_t act;
         do {
-            act = static_cast<size_t>(std::rand() * 4.0 / (double)RAND_MAX);
+            act = static_cast<size_t>(mcts::rng::below(4));
         } while (!valid(act));
 
         return act;
@@ -153,6 +157,23 @@ struct GridState {
     }
 };
 
+namespace mcts {
+    template <>
+    struct child_hash<GridState> {
+        static size_t hash(const GridState& state)
+        {
+            return state._x * state._N + state._y;
+        }
+    };
+} // namespace mcts
+
+#ifdef TRANSPOSITIONS
+// cells reached along different paths share their node
+using OutcomeSelect = mcts::TranspositionOutcomeSelect<Params>;
+#else
+using OutcomeSelect = mcts::SimpleOutcomeSelect;
+#endif
+
 struct GridWorld {
     template <typename State>
     double operator()(std::shared_ptr<State> from_state, size_t action, std::shared_ptr<State> to_state)
@@ -184,7 +205,7 @@ struct BestHeuristicPolicy {
 
 int main()
 {
-    std::srand(std::time(0));
+    mcts::rng::seed(std::time(0));
     mcts::par::init();
 
     GridWorld world;
@@ -205,20 +226,21 @@ int main()
                 for (size_t j = 0; j < s; j++) {
                     auto t1 = std::chrono::steady_clock::now();
                     GridState init(i, j, s, p);
-                    auto tree = std::make_shared<mcts::MCTSNode<Params, GridState, mcts::SimpleStateInit<GridState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, BestHeuristicPolicy<GridState, size_t>, size_t, mcts::SimpleSelectPolicy, mcts::SimpleOutcomeSelect>>(init, 10000);
-                    const int N_ITERATIONS = 10000;
-                    const int MIN_ITERATIONS = 1000;
-                    int k;
-                    for (k = 0; k < N_ITERATIONS; ++k) {
-                        tree->iterate(world);
-                        if (k >= MIN_ITERATIONS) {
-                            auto best = tree->best_action();
-                            if (best != nullptr && (best->action() == 0 || best->action() == 2)) {
-                                if (!(init._x == (s - 1) && best->action() != 0) && !(init._y == (s - 1) && best->action() != 2))
-                                    break;
-                            }
+                    auto tree = std::make_shared<mcts::MCTSNode<Params, GridState, mcts::SimpleStateInit<GridState>, mcts::SimpleValueInit, mcts::UCTValue<Params>, BestHeuristicPolicy<GridState, size_t>, size_t, mcts::SimpleSelectPolicy, OutcomeSelect>>(init, 10000);
+                    const size_t N_ITERATIONS = 10000;
+                    const size_t MIN_ITERATIONS = 1000;
+                    // stop early once the best action moves towards the goal
+                    auto found_path = [&](auto& root, size_t iterations) {
+                        if (iterations <= MIN_ITERATIONS)
+                            return false;
+                        auto best = root.best_action();
+                        if (best != nullptr && (best->action() == 0 || best->action() == 2)) {
+                            if (!(init._x == (s - 1) && best->action() != 0) && !(init._y == (s - 1) && best->action() != 2))
+                                return true;
                         }
-                    }
+                        return false;
+                    };
+                    size_t k = tree->compute(world, mcts::stop_any(mcts::IterationBudget(N_ITERATIONS), found_path));
                     auto time_running = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t1).count();
                     avg_time += time_running / 1000.0;
                     avg += k;